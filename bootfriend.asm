@@ -18,7 +18,7 @@
 ; ERROR CODES:
 ; 11 [A] = XMODEM transfer - block transfer issue (ID != ~ID)
 ; 12 [B] = XMODEM transfer - block transfer issue (ID mismatch)
-; 13 [C] = XMODEM transfer - cancelled
+; 13 [C] = XMODEM transfer - cancelled (waits for the transfer to be resumed)
 ; 14 [D] = XMODEM transfer - invalid data (magic mismatch)
 ; 15 [E]
 ; 16 [F]
@@ -47,6 +47,18 @@ bits 16
 cpu 186
 org 0x0000
 
+; DEV adds developer features to the loader: booting from cartridge SRAM
+; (Y4) and multi-segment 'bS' files. They take room from the splash data in
+; the IEEPROM, so release builds leave them out.
+
+; Blank tiles in the ROM build's placeholder splash; as many as fit next
+; to the code.
+%ifdef DEV
+%define ROM_TILE_COUNT 54
+%else
+%define ROM_TILE_COUNT 64
+%endif
+
 	db 'b', 'F', 't' ; Padding
 	db 'M' ; Console flags
 	db 'p' ; Console name color
@@ -56,12 +68,13 @@ org 0x0000
 	db 0x80 ; End frame
 	db 0 ; Sprite count
 	db 0x81 ; Palette flags
-	db 64 ; Tile count
 %ifdef ROM
+	db ROM_TILE_COUNT ; Tile count
 	dw paletteData
 	dw tilesetData
 	dw tilemapData
 %else
+	db 64 ; Tile count
 	dw ffffPointer
 	dw ffffPointer
 	dw ffffPointer
@@ -89,16 +102,29 @@ ffffPointer:
 times 0x40-($-$$) db 0x00 ; Padding
 
 %define BFB_HEADER_SIZE	4
-%define xmBuffer     0xFF00 ; 128 bytes
+%define ldFirstBlock (0x6800 - BFB_HEADER_SIZE) ; 'bF' data lands at 0x6800
+%define BFB_MAX_SIZE (0xFE00 - ldFirstBlock)
 %define xmExpectedId 0xFF9D ; 1 byte
 %define ldStartAddr  0xFF9E ; 2 bytes
 %define ldStartOffs  0xFFA0 ; 2 bytes (set to 0 by clear routine)
 %define ldScrPos     0xFFA2 ; 2 bytes
 %define xmLastDownloadFailed 0xFFA4 ; 1 byte
+%define ldPackedAddr 0xFFA6 ; 2 bytes (set to 0 by clear routine)
+%define ldSavedSp    0xFFA8 ; 2 bytes
+%define ldLastBlock  0xFFAA ; 2 bytes
+%define ldSegCount   0xFFAC ; 1 byte, segments left (set to 0 by clear routine)
+%define ldLimit      0xFFAE ; 2 bytes, end of the current segment
+%define ldSegNext    0xFFB0 ; 2 bytes, next entry of ldSegTable
+%define ldSegTable   0xFF20 ; 'bS' segment table, up to 0xFF98
+%define BFB_SEGMENTED_HEADER_SIZE 1024
+%define BFB_MAX_SEGMENTS 20
 %define SOH 1
+%define STX 2
 %define EOT 4
+%define ENQ 5
 %define ACK 6
 %define NAK 21
+%define SYN 22
 %define CAN 24
 
 bootFriendVersion:
@@ -162,6 +188,11 @@ bootfriend_check:
 vbl_noPCv2Strap:
 	test al, 0x04 ; Hello mode? (Y3)
 	jnz bootfriend_hello
+
+%ifdef DEV
+	test al, 0x08 ; Boot from cartridge SRAM? (Y4)
+	jnz bootfriend_sram ; wcet: not taken (boots the payload, never returns)
+%endif
 	
 	test al, 0x02 ; 9600 baud mode? (Y2)
 	mov al, 0xA0
@@ -218,6 +249,8 @@ irq_serial:
 	in al, IO_SERIAL_DATA
 	cmp al, SOH
 	je loader_start
+	cmp al, STX
+	je loader_start
 
 	; Acknowledge interrupt.
 	mov al, HWINT_SERIAL_RX
@@ -238,10 +271,13 @@ bootfriend_takeover_init:
 	; Clear memory - assumes AX = 0x0000
 	mov di, 0xFFA0
 	mov cx, 0x08
-	rep stosw
+	rep stosw ; wcet: 8
 
 	; Init display
 	mov di, 0xFE00
+%ifdef DEV
+	mov [ldLimit], di ; End of the load area
+%endif
 	; xor ax, ax Accomplished above.
 	out IO_SCR1_SCRL_X, ax ; Clear Screen 1 scroll
 	stosw ; Set color 0:0 to black
@@ -255,26 +291,55 @@ bootfriend_takeover_init:
 
 	ret
 
+%ifdef DEV
+	; Boot the .bfb file stored at the start of cartridge SRAM (bank 0):
+	; copy it to where the first XMODEM block would have been received,
+	; then load it the same way, but without a transfer.
+bootfriend_sram:
+	call bootfriend_takeover_init
+	dec ax ; AX = 0
+	out IO_BANK_RAM, al
+	mov word cs:[loader_first_block_next + 1], loader_unpack - (loader_first_block_next + 3)
+
+	mov ax, 0x1000
+	mov ds, ax
+	xor si, si
+	mov di, ldFirstBlock
+	mov cx, BFB_MAX_SIZE / 2
+	rep movsw
+	push es
+	pop ds
+
+	cmp word [ldFirstBlock], 0x4662 ; 'bF' only; SRAM may hold anything
+	mov bl, 14 ; 'D'
+	jne loader_fail_end
+	mov dx, BFB_MAX_SIZE
+	jmp loader_first_block
+%endif
+
 ; BARE-BONES XMODEM LOADER
 
 	; We have ~500 cycles to spend here, ideally. Let's make them count.
 loader_start:
+	push ax
 	call bootfriend_takeover_init
+	pop ax
 
 	; Read first block.
-	call loader_read_block
-	mov [xmLastDownloadFailed], bl
-	call loader_putc ; Output status character
-	cmp bl, 42
-	je loader_first_block_done
-	call loader_full_read_block_resend_nak
-loader_first_block_done:
-	; Copy block to load area.
-	mov si, xmBuffer
+	mov di, ldFirstBlock
+	mov [ldLastBlock], di
+	call loader_full_read_block_first
+loader_first_block:
+	; DX = bytes at ldFirstBlock
+	mov si, ldFirstBlock
 	lodsw ; Magic
-	cmp ax, 0x4662 ; 'bF'
+	cmp ax, 0x4662 ; 'bF', 'bS', 'bZ'
 	mov bl, 14 ; 'D'
 	jb loader_fail_end
+%ifdef DEV
+	cmp ax, 0x5362 ; 'bS'
+	je loader_segmented
+%endif
 
 	lodsw ; Address
 	mov [ldStartAddr], ax
@@ -291,33 +356,93 @@ loader_non_relocatable:
 	mov bl, 28 ; 'R'
 	jb loader_fail_end
 
+	sub dx, BFB_HEADER_SIZE
+	cmp byte [ldFirstBlock + 1], 'Z'
+	jne loader_move_first_block
+
+	; Compressed - load packed data at the address given, unpack to AX later.
+	; It may not be below the first block's data (SI), which is moved there
+	; backwards.
 	mov di, ax
-	mov si, xmBuffer + BFB_HEADER_SIZE
-	mov cx, ((128 - BFB_HEADER_SIZE) >> 1)
-	rep movsw
+	lodsw ; Packed data address
+	dec dx
+	dec dx
+	cmp ax, si
+	jb loader_fail_end
+	push di
+	mov [ldPackedAddr], ax
 
-	mov al, ACK
-	call serial_putc_block
+loader_move_first_block:
+	; Where a resent first block would be received to, header included.
+	mov bp, ldFirstBlock
+	sub bp, si
+	add bp, ax
 
-	; Read next blocks.
-loader_next_block:
-	cmp di, 0xFD80
-	mov bl, 28 ; 'R'
-	jae loader_fail_end
+	; Move the first block's data to its load or packed data address, which
+	; is never below it; copy backwards in case the two overlap.
+	mov di, ax
+	mov cx, 0xFE00
+	sub cx, di
+	jbe loader_fail_end
+	cmp cx, dx
+	jb loader_move_first_block_clip
+	mov cx, dx
+loader_move_first_block_clip:
+	add si, cx
+	add di, cx
 	push di
+	dec si
+	dec di
+	std
+	rep movsb
+	cld
+	pop di
+%ifdef DEV
+loader_first_block_next:
+	; Patched to jump to loader_unpack when booting from SRAM.
+	jmp near loader_block_done
+%else
+	jmp loader_block_done
+%endif
+
+loader_fail_end:
+	call loader_putc
+loader_fail_end_loop:
+	jmp loader_fail_end_loop
 
+%ifdef DEV
+loader_segmented:
+	; 'bS': entry point, segment count and table, padded to 1024 bytes;
+	; the segments' data follows, in order.
+	mov di, ldStartAddr
+	movsw ; Entry point offset
+	movsw ; Entry point segment
+	lodsw ; Segment count
+	cmp al, BFB_MAX_SEGMENTS
+	ja loader_fail_end
+	mov [ldSegCount], al
+	mov di, ldSegTable
+	mov [ldSegNext], di
+	mov cx, BFB_MAX_SEGMENTS * 3
+	rep movsw
+
+	; Receive the rest of the header after the first block, then move on
+	; to the first segment.
+	mov bp, ldFirstBlock
+	mov di, bp
+	add di, dx
+	mov word [ldLimit], ldFirstBlock + BFB_SEGMENTED_HEADER_SIZE
+	jmp loader_block_done
+%endif
+
+	; Read next blocks, directly into the load area.
+loader_next_block:
 	call loader_full_read_block
 	cmp bl, 0xFF
 	je loader_blocks_done
-	cmp bl, 42 ; This and v is probably refactorable.
-	jne loader_fail_end
-
-	; Copy block to load area.
-	pop di
-	mov si, xmBuffer
-	mov cx, (128 >> 1)
-	rep movsw
 
+loader_block_done:
+	mov [ldLastBlock], bp
 	call serial_putc_ack
 	jmp loader_next_block
 
@@ -327,49 +452,122 @@ loader_blocks_done:
 	jne loader_fail_end_loop
 
 	call serial_putc_ack
-	
+
+loader_unpack:
+	; Unpack compressed data, if any.
+	; 0x00 = end, 0x01-0x7F = literal run, 0x80-0xFF = match of length
+	; (token & 0x7F) + 3 at a 16-bit backwards distance.
+	mov si, [ldPackedAddr]
+	test si, si
+	jz loader_unpack_done
+	pop di
+	xor cx, cx
+loader_unpack_token:
+	lodsb
+	test al, al
+	jz loader_unpack_done
+	mov cl, al
+	js loader_unpack_match
+	rep movsb
+	jmp loader_unpack_token
+loader_unpack_match:
+	and cl, 0x7F
+	add cl, 3
+	lodsw ; Distance
+	push si
+	mov si, di
+	sub si, ax
+	rep movsb
+	pop si
+	jmp loader_unpack_token
+
+loader_unpack_done:
 	jmp far [ldStartAddr]
 
-	; Read one XMODEM block into xmBuffer. Waits for SOH, repeats, etc.
-	; Does not acknowledge.
-	; Trashes AX, BX, CX, DI
-	; Returns BL=255 on no more blocks, BL=42 otherwise
+	; Read one XMODEM block to DI. Waits for SOH/STX, repeats, etc.
+	; Does not acknowledge. Never gives up: if the host cancels or goes
+	; away, it can query the block index and load pointer with ENQ and
+	; resume the transfer from there.
+	; Trashes AX, BX, CX, SI, BP
+	; Returns BL=255 on no more blocks, BL=42, DX=block size, BP=block
+	; start and DI past the block otherwise
+loader_full_read_block_first:
+	; Enter with the first block's SOH/STX already in AL.
+	mov [ldSavedSp], sp
+	mov bp, di
+	jmp loader_full_read_block_data
+
+loader_resume_query:
+	; Reply with SYN, expected block ID, load pointer and, with DEV,
+	; segments left.
+	mov al, SYN
+	call serial_putc_block
+	mov al, [xmExpectedId]
+	call serial_putc_block
+	mov ax, di
+	call serial_putc_block
+	mov al, ah
+%ifdef DEV
+	call serial_putc_block
+	mov al, [ldSegCount]
+%endif
+	jmp loader_full_read_block_reply
+
 loader_full_read_block_resend_nak:
 	mov al, NAK
+loader_full_read_block_reply:
 	call serial_putc_block
 loader_full_read_block:
+	; serial_getc_block returns here on timeout, with DI rolled back.
+	mov [ldSavedSp], sp
+	mov bp, di
 	call serial_getc_block
 
-	cmp al, CAN
-	mov bl, 13 ; 'C'
-	je loader_fail_end ; Cancelled - nothing we can do
-
 	cmp al, EOT
 	mov bl, 0xFF ; <nothing>
 	je loader_full_read_block_end ; EOT - finish reading blocks
 
+	cmp al, ENQ
+	je loader_resume_query
+
+	cmp al, CAN
+	mov bl, 13 ; 'C'
+	je loader_full_read_block_status ; Cancelled - wait for a resume
+
 	cmp al, SOH
-	jne loader_full_read_block_resend_nak ; !SOH - NAK?
+	je loader_full_read_block_data
+	cmp al, STX
+	jne loader_full_read_block_purge ; !SOH, !STX - NAK once quiet
 
-	call loader_read_block ; SOH - read full block
+loader_full_read_block_data:
+	call loader_read_block ; SOH/STX - read full block
 	mov [xmLastDownloadFailed], bl
+loader_full_read_block_status:
 	call loader_putc ; Output status character
 	cmp bl, 42
-	jne loader_full_read_block_resend_nak ; Resend NAK if error
+	je loader_full_read_block_end
+	cmp bl, 21 ; 'K'
+	je loader_full_read_block_resend_nak ; Bad checksum - the line is quiet
+loader_full_read_block_purge:
+	; Skip the rest of whatever was sent; NAK once the line goes quiet.
+	call serial_getc_block
+	jmp loader_full_read_block_purge
 loader_full_read_block_end:
 	ret
 
-loader_fail_end:
-	call loader_putc
-loader_fail_end_loop:
-	jmp loader_fail_end_loop
-
-	; Read one XMODEM block into xmBuffer, after SOH.
-	; trashes AX, CX, DI
-	; returns BL = 42 on success, other on failure
+	; Read one XMODEM block to DI, after SOH or STX (in AL).
+	; Anything past 0xFDFF can only be the padding of the final block,
+	; so it is checksummed, but dropped.
+	; trashes AX, CX, SI, BP
+	; returns BL = 42 on success, other on failure; DX = block size
+	; DI is advanced past the block on success only
 loader_read_block:
-	mov di, xmBuffer
+	mov dx, 128
+	cmp al, SOH
+	je loader_read_block_header
+	mov dx, 1024
 
+loader_read_block_header:
 	call serial_getc_block
 	mov ah, al
 	call serial_getc_block
@@ -380,12 +578,41 @@ loader_read_block:
 	jne loader_read_block_return
 	; ID == expected ID?
 	mov bl, 12 ; 'B'
-	cmp al, [xmExpectedId]
-	jne loader_read_block_return
+	sub al, [xmExpectedId]
+	jz loader_read_block_data
+	; ID == expected ID - 1? Our ACK got lost, so the host sent the last
+	; block again; receive it over itself. If the host has since fallen
+	; back to smaller blocks, this also rewinds the load pointer to match.
+	inc al
+	jnz loader_read_block_return
+	dec byte [xmExpectedId]
+	mov di, [ldLastBlock]
 
 loader_read_block_data:
-	mov cx, 128
-	mov di, xmBuffer
+%ifdef DEV
+	cmp di, [ldLimit]
+	jb loader_read_block_segment
+	call loader_next_segment
+loader_read_block_segment:
+	mov bp, di
+	mov cx, [ldLimit]
+%else
+	mov bp, di
+	mov cx, 0xFE00
+%endif
+	sub cx, di
+	mov bl, 28 ; 'R'
+	jbe loader_read_block_fail
+	cmp cx, dx
+%ifdef DEV
+	jb loader_read_block_short
+%else
+	jb loader_read_block_clip
+%endif
+	mov cx, dx
+loader_read_block_clip:
+	mov si, dx
+	sub si, cx
 	xor ah, ah
 
 loader_read_block_loop:
@@ -393,23 +620,91 @@ loader_read_block_loop:
 	add ah, al
 	stosb
 	loop loader_read_block_loop
-	
+
+	mov cx, si
+	jcxz loader_read_block_checksum
+loader_read_block_drop_loop:
+	call serial_getc_block
+	add ah, al
+	loop loader_read_block_drop_loop
+
+loader_read_block_checksum:
 	; Checksum + Check
 	call serial_getc_block
 	mov bl, 21 ; 'D'
 	cmp ah, al
-	jne loader_read_block_return
+	je loader_read_block_ok
+	mov di, bp ; Roll back
+	ret
+
+loader_read_block_ok:
 
 	mov bl, 42 ; '.'
 	inc byte [xmExpectedId]
 loader_read_block_return:
 	ret
 
+%ifdef DEV
+loader_read_block_short:
+	; Only the last segment may end within a block; the rest is padding.
+	cmp byte [ldSegCount], 0
+	je loader_read_block_clip
+%endif
+loader_read_block_fail:
+	jmp loader_fail_end
+
+%ifdef DEV
+	; Move on to the next segment of a 'bS' file, once the current one is
+	; full; there is none for other files.
+	; Sets ES:DI and ldLimit; trashes AX, BL, SI
+loader_next_segment:
+	mov bl, 28 ; 'R'
+	dec byte [ldSegCount]
+	js loader_read_block_fail
+	mov si, [ldSegNext]
+	lodsw ; Address
+	xchg di, ax
+	lodsw ; Length
+	add ax, di
+	jc loader_read_block_fail
+	mov [ldLimit], ax
+	lodsw ; SRAM bank, or 0xFF for IRAM
+	mov [ldSegNext], si
+	cmp al, 0xFF
+	je loader_next_segment_iram
+	out IO_BANK_RAM, al
+	mov ax, 0x1000
+	mov es, ax
+	ret
+loader_next_segment_iram:
+	; Same range as for other files.
+	cmp di, 0x6800
+	jb loader_read_block_fail
+	cmp word [ldLimit], 0xFE00
+	ja loader_read_block_fail
+	push ds
+	pop es
+	ret
+%endif
+
 	; Read one byte from the serial port into AL.
+	; After ~0.3 seconds of silence, gives up on the block being read:
+	; rolls DI back to BP and restarts loader_full_read_block with a NAK.
 serial_getc_block:
+	push cx
+	xor cx, cx
+serial_getc_block_wait:
 	in al, IO_SERIAL_STATUS
 	test al, 0x01
-	jz serial_getc_block
+	jnz serial_getc_block_ready ; wcet: taken (waiting is not work)
+	loop serial_getc_block_wait
+
+	mov sp, [ldSavedSp]
+	mov di, bp
+	jmp loader_full_read_block_resend_nak
+
+serial_getc_block_ready:
+	pop cx
 	in al, IO_SERIAL_DATA
 	ret
 
@@ -418,23 +713,24 @@ serial_putc_ack:
 	mov al, ACK
 serial_putc_block:
 	push ax
+serial_putc_block_wait:
 	in al, IO_SERIAL_STATUS
 	test al, 0x04
-	jz serial_putc_block
+	jz serial_putc_block_wait ; wcet: not taken
 	pop ax
 	out IO_SERIAL_DATA, al
 	ret
 
 	; Put one
 	; BL = character
-	; trashes AX, DI
+	; trashes AX, SI
 loader_putc:
 	push bx
 	xor bh, bh
 	mov ax, [ldScrPos]
-	mov di, 0x0800
-	add di, ax
-	mov [di], bx
+	mov si, 0x0800
+	add si, ax
+	mov [si], bx
 	add al, 2
 	mov [ldScrPos], ax
 	mov bx, ax
@@ -461,7 +757,7 @@ paletteData:
 	dw 0x0000
 
 tilesetData:
-	times 512 dw 0
+	times ROM_TILE_COUNT * 8 dw 0
 
 tilemapData:
 	times 64 dw 0
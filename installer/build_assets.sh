@@ -1,7 +1,9 @@
 #!/bin/sh
 echo "[ Compiling 8x8 font ]"
-python3 ../tools/font2raw.py ../res/font_default.png 8 8 a res/font_default.bin
-python3 ../tools/bin2c.py res/font_default.c res/font_default.h res/font_default.bin
+python3 ../tools/font2raw.py ../res/font_default.png 8 8 2 res/font_default.bin
+python3 ../tools/bin2c.py --align 2 res/font_default.c res/font_default.h res/font_default.bin
 echo "[ Compiling BootFriend ]"
-python3 ../tools/bin2c.py res/bootfriend.c res/bootfriend.h ../bootfriend.bin
+python3 ../tools/bin2c.py --align 2 res/bootfriend.c res/bootfriend.h ../bootfriend.bin
+# for the DEV installer (make -f Makefile.rom DEV=1)
+python3 ../tools/bin2c.py --align 2 res/bootfriend_dev.c res/bootfriend_dev.h ../bootfriend_dev.bin
 
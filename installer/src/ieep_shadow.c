@@ -0,0 +1,247 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wonderful.h>
+#include <ws.h>
+#include "ieep_shadow.h"
+#include "trace.h"
+
+// Internal EEPROM ports, driven directly by the write queue so that it
+// never has to wait for the chip.
+#define IEEP_PORT_DATA 0xBA
+#define IEEP_PORT_CMD  0xBC
+#define IEEP_PORT_CTRL 0xBE
+
+#define IEEP_CTRL_READ_DONE 0x01
+#define IEEP_CTRL_READY     0x02
+#define IEEP_CTRL_READ      0x10
+#define IEEP_CTRL_WRITE     0x20
+#define IEEP_CTRL_SHORT     0x40
+
+// 93C86-style commands, 10 address bits (1024 words)
+#define IEEP_CMD_EWEN       0x1300
+#define IEEP_CMD_WRITE(a)   (0x1400 | ((a) >> 1))
+#define IEEP_CMD_READ(a)    (0x1800 | ((a) >> 1))
+
+// While writes are queued, the HBlank timer services the queue every
+// IEEP_TIMER_PERIOD lines (about 0.7 ms), so that each step follows the
+// chip closely instead of waiting for the next frame. Profiling builds
+// use the timer for sampling; their handler services the queue as well.
+#if !defined(__WONDERFUL_WWITCH__) && !defined(PROFILE)
+#define IEEP_USE_TIMER
+#define TIMER_PORT_CTRL 0xA2
+#define TIMER_PORT_HBLANK_RELOAD 0xA4
+#define TIMER_HBLANK_ENABLE 0x01
+#define TIMER_HBLANK_REPEAT 0x02
+#define IEEP_TIMER_PERIOD 8
+
+extern void ieep_timer_int_handler(void);
+#endif
+
+#define IEEP_QUEUE_IDLE    0
+#define IEEP_QUEUE_WRITING 1
+#define IEEP_QUEUE_READING 2
+
+typedef struct {
+	uint16_t address;
+	uint16_t value;
+} ieep_queue_entry_t;
+
+__attribute__((aligned(2)))
+uint8_t ieep_shadow[IEEP_SHADOW_SIZE];
+
+// The head is only moved by ieep_shadow_queue_word(), the tail only by
+// ieep_shadow_update().
+static ieep_queue_entry_t ieep_queue[IEEP_QUEUE_SIZE];
+static volatile uint8_t ieep_queue_head, ieep_queue_tail;
+static uint8_t ieep_queue_state;
+static uint8_t ieep_queue_writes;
+static ieep_shadow_callback_t ieep_queue_callback;
+#ifdef IEEP_USE_TIMER
+static bool ieep_timer_running;
+#endif
+
+void ieep_shadow_load(void) {
+	ieep_shadow_load_range(0, IEEP_SHADOW_SIZE);
+}
+
+void ieep_shadow_load_range(uint16_t address, uint16_t length) {
+	ieep_shadow_flush();
+	trace_begin(TRACE_IEEP_LOAD);
+	ws_eeprom_read_data(ws_eeprom_handle_internal(), address, ieep_shadow + address, length);
+	trace_end(TRACE_IEEP_LOAD);
+}
+
+uint8_t ieep_shadow_write_word(uint16_t address, uint16_t value) {
+	ws_eeprom_handle_t ieep_handle = ws_eeprom_handle_internal();
+	uint16_t *shadow = (uint16_t*) (ieep_shadow + address);
+	if (*shadow == value) return 0;
+
+	ieep_shadow_flush();
+	for (uint8_t i = 1; i <= IEEP_SHADOW_WRITE_ATTEMPTS; i++) {
+		trace_begin(TRACE_IEEP_WRITE);
+		ws_eeprom_write_word(ieep_handle, address, value);
+		trace_end(TRACE_IEEP_WRITE);
+		trace_begin(TRACE_IEEP_VERIFY);
+		*shadow = ws_eeprom_read_word(ieep_handle, address);
+		trace_end(TRACE_IEEP_VERIFY);
+		if (*shadow == value) return i;
+	}
+	return IEEP_SHADOW_WRITE_FAILED;
+}
+
+void ieep_shadow_set_callback(ieep_shadow_callback_t callback) {
+	ieep_queue_callback = callback;
+}
+
+uint8_t ieep_shadow_queue_depth(void) {
+	return (ieep_queue_head - ieep_queue_tail) & (IEEP_QUEUE_SIZE - 1);
+}
+
+#ifdef IEEP_USE_TIMER
+static void ieep_timer_start(void) {
+	cpu_irq_disable();
+	if (!ieep_timer_running) {
+		ws_hwint_set_handler(HWINT_IDX_HBLANK_TIMER, ieep_timer_int_handler);
+		outportw(TIMER_PORT_HBLANK_RELOAD, IEEP_TIMER_PERIOD);
+		outportb(TIMER_PORT_CTRL, inportb(TIMER_PORT_CTRL) | TIMER_HBLANK_ENABLE | TIMER_HBLANK_REPEAT);
+		ws_hwint_ack(HWINT_HBLANK_TIMER);
+		ws_hwint_enable(HWINT_HBLANK_TIMER);
+		ieep_timer_running = true;
+	}
+	cpu_irq_enable();
+}
+
+// Interrupts disabled.
+static void ieep_timer_stop(void) {
+	if (!ieep_timer_running) return;
+	ws_hwint_disable(HWINT_HBLANK_TIMER);
+	outportb(TIMER_PORT_CTRL, inportb(TIMER_PORT_CTRL) & ~(TIMER_HBLANK_ENABLE | TIMER_HBLANK_REPEAT));
+	ws_hwint_ack(HWINT_HBLANK_TIMER);
+	ieep_timer_running = false;
+}
+#endif
+
+// Wait for the queue to move on.
+static void ieep_shadow_wait(void) {
+#ifdef __WONDERFUL_WWITCH__
+	// no interrupt handlers of our own; drive the queue from here
+	cpu_irq_disable();
+	ieep_shadow_update();
+	cpu_irq_enable();
+#else
+	// the interrupt handlers do the work
+	cpu_halt();
+#endif
+}
+
+bool ieep_shadow_queue_word(uint16_t address, uint16_t value) {
+	uint16_t *shadow = (uint16_t*) (ieep_shadow + address);
+	if (*shadow == value) return false;
+	*shadow = value;
+
+	uint8_t head = ieep_queue_head;
+	uint8_t next_head = (head + 1) & (IEEP_QUEUE_SIZE - 1);
+	while (next_head == ieep_queue_tail) {
+		ieep_shadow_wait();
+	}
+
+	if (head == ieep_queue_tail) {
+		// The queue is idle, and so is the chip; make sure it accepts
+		// writes.
+		outportw(IEEP_PORT_CMD, IEEP_CMD_EWEN);
+		outportb(IEEP_PORT_CTRL, IEEP_CTRL_SHORT);
+		while (!(inportb(IEEP_PORT_CTRL) & IEEP_CTRL_READY)) { }
+	}
+
+	ieep_queue[head].address = address;
+	ieep_queue[head].value = value;
+	// the entry must be in place before the interrupt handler can see it
+	__asm volatile ("" ::: "memory");
+	ieep_queue_head = next_head;
+#ifdef IEEP_USE_TIMER
+	ieep_timer_start();
+#endif
+	return true;
+}
+
+void ieep_shadow_flush(void) {
+	while (ieep_queue_head != ieep_queue_tail) {
+		ieep_shadow_wait();
+	}
+}
+
+/**
+ * Advance the write queue by one state, if the chip allows it.
+ * @return Whether the queue moved on.
+ */
+static bool ieep_shadow_step(void) {
+	uint8_t tail = ieep_queue_tail;
+	if (tail == ieep_queue_head) return false;
+	ieep_queue_entry_t *entry = &ieep_queue[tail];
+
+	switch (ieep_queue_state) {
+	case IEEP_QUEUE_WRITING:
+		// read the word back once the write has finished
+		if (!(inportb(IEEP_PORT_CTRL) & IEEP_CTRL_READY)) return false;
+		trace_end(TRACE_IEEP_WRITE);
+		trace_begin(TRACE_IEEP_VERIFY);
+		outportw(IEEP_PORT_CMD, IEEP_CMD_READ(entry->address));
+		outportb(IEEP_PORT_CTRL, IEEP_CTRL_READ);
+		ieep_queue_state = IEEP_QUEUE_READING;
+		return true;
+	case IEEP_QUEUE_READING: {
+		if (!(inportb(IEEP_PORT_CTRL) & IEEP_CTRL_READ_DONE)) return false;
+		uint16_t value = inportw(IEEP_PORT_DATA);
+		trace_end(TRACE_IEEP_VERIFY);
+		if (value != entry->value) {
+			if (ieep_queue_writes < IEEP_SHADOW_WRITE_ATTEMPTS) break;
+			*((uint16_t*) (ieep_shadow + entry->address)) = value;
+			ieep_queue_writes = IEEP_SHADOW_WRITE_FAILED;
+		}
+		if (ieep_queue_callback != NULL) {
+			ieep_queue_callback(entry->address, ieep_queue_writes);
+		}
+		ieep_queue_writes = 0;
+		ieep_queue_state = IEEP_QUEUE_IDLE;
+		ieep_queue_tail = (tail + 1) & (IEEP_QUEUE_SIZE - 1);
+		return true;
+	}
+	}
+
+	// IEEP_QUEUE_IDLE, or a write which did not stick
+	if (!(inportb(IEEP_PORT_CTRL) & IEEP_CTRL_READY)) return false;
+	trace_begin(TRACE_IEEP_WRITE);
+	outportw(IEEP_PORT_DATA, entry->value);
+	outportw(IEEP_PORT_CMD, IEEP_CMD_WRITE(entry->address));
+	outportb(IEEP_PORT_CTRL, IEEP_CTRL_WRITE);
+	ieep_queue_writes++;
+	ieep_queue_state = IEEP_QUEUE_WRITING;
+	return true;
+}
+
+void ieep_shadow_update(void) {
+	// Finishing a word and starting the next one's write take no time;
+	// only wait for the chip between interrupts.
+	while (ieep_shadow_step()) { }
+#ifdef IEEP_USE_TIMER
+	if (ieep_queue_tail == ieep_queue_head) ieep_timer_stop();
+#endif
+}
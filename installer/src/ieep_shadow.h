@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IEEP_SHADOW_SIZE 2048
+
+/**
+ * A copy of the internal EEPROM, kept in IRAM. It is read from the chip
+ * once, by ieep_shadow_load(); afterwards, all writes go through
+ * ieep_shadow_write_word() or ieep_shadow_queue_word(), which keep both
+ * copies in sync.
+ */
+extern uint8_t ieep_shadow[IEEP_SHADOW_SIZE];
+
+void ieep_shadow_load(void);
+/**
+ * Re-read part of the shadow from the chip.
+ */
+void ieep_shadow_load_range(uint16_t address, uint16_t length);
+
+static inline uint16_t ieep_shadow_read_word(uint16_t address) {
+	return *((uint16_t*) (ieep_shadow + address));
+}
+
+#define IEEP_SHADOW_WRITE_ATTEMPTS 4
+#define IEEP_SHADOW_WRITE_FAILED 0xFF
+
+/**
+ * Write a word to the internal EEPROM, unless it already holds that value.
+ * Each write is read back from the chip, and retried if it did not stick.
+ * Returns the number of writes made (0 if the word was already up to date),
+ * or IEEP_SHADOW_WRITE_FAILED if the word could not be written; the shadow
+ * then holds the value read back.
+ */
+uint8_t ieep_shadow_write_word(uint16_t address, uint16_t value);
+
+#define IEEP_QUEUE_SIZE 64
+
+/**
+ * Called when a queued write has finished, with the number of writes made
+ * or IEEP_SHADOW_WRITE_FAILED. May run in interrupt context.
+ */
+typedef void (*ieep_shadow_callback_t)(uint16_t address, uint8_t writes);
+
+void ieep_shadow_set_callback(ieep_shadow_callback_t callback);
+
+/**
+ * Queue a word to be written to the internal EEPROM, unless it already
+ * holds that value. The shadow is updated at once; the write itself is
+ * made in the background, from the HBlank timer and VBlank interrupts
+ * (on WonderWitch, while waiting for the queue), and read back like in
+ * ieep_shadow_write_word().
+ * Sleeps while the queue is full. Returns true if a write was queued.
+ */
+bool ieep_shadow_queue_word(uint16_t address, uint16_t value);
+
+/**
+ * @return The number of queued writes which have not finished yet.
+ */
+uint8_t ieep_shadow_queue_depth(void);
+
+/**
+ * Wait until all queued writes have finished.
+ */
+void ieep_shadow_flush(void);
+
+/**
+ * Advance the write queue as far as the chip allows without waiting;
+ * called from the VBlank and HBlank timer interrupt handlers, with
+ * interrupts disabled.
+ */
+void ieep_shadow_update(void);
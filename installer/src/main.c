@@ -23,10 +23,20 @@
 #include <sys/bios.h>
 #endif
 
+#ifdef DEV
+// The developer build of BootFriend, which can also boot from SRAM.
+#include "bootfriend_dev.h"
+#define _bootfriend_bin _bootfriend_dev_bin
+#define _bootfriend_bin_size _bootfriend_dev_bin_size
+#else
 #include "bootfriend.h"
+#endif
 #include "boot_splash.h"
 #include "font_default.h"
+#include "ieep_shadow.h"
 #include "input.h"
+#include "profile.h"
+#include "trace.h"
 #include "ui.h"
 #include "util.h"
 #include "xmodem.h"
@@ -71,12 +81,13 @@ void boot_header_mark_changed(void) {
 
 void boot_header_refresh(void) {
 	if (!boot_header_update_required) return;
-	ws_eeprom_read_data(ws_eeprom_handle_internal(), 0x80, (uint8_t*) &boot_header_data, sizeof(ws_boot_splash_header_t));
+	memcpy(&boot_header_data, ieep_shadow + 0x80, sizeof(ws_boot_splash_header_t));
 	boot_header_splash_valid = ws_boot_splash_is_header_valid(&boot_header_data);
 	boot_header_update_required = false;
 }
 
 static void statusbar_update(void) {
+	trace_begin(TRACE_UI_STATUSBAR);
 	boot_header_refresh();
 	char buf[29];
 
@@ -106,12 +117,13 @@ static void statusbar_update(void) {
 		buf[0] = '?'; buf[1] = 0;
 	}
 	ui_puts(28 - strlen(buf), 1, splash_active ? COLOR_BLACK : COLOR_GRAY, buf);
+	trace_end(TRACE_UI_STATUSBAR);
 }
 
 static void toggle_boot_splash(void) {
-	uint16_t word_0x82 = ws_eeprom_read_word(ws_eeprom_handle_internal(), 0x82);
+	uint16_t word_0x82 = ieep_shadow_read_word(0x82);
 	word_0x82 ^= (IEEP_C_OPTIONS1_CUSTOM_SPLASH << 8);
-	ws_eeprom_write_word(ws_eeprom_handle_internal(), 0x82, word_0x82);
+	ieep_shadow_write_word(0x82, word_0x82);
 
 	boot_header_mark_changed();
 	statusbar_update();
@@ -127,7 +139,7 @@ extern void bootfriend_vblank_handler(void);
 
 static void test_bootfriend(void) {
 	// copy BootFriend to IRAM
-	memcpy((uint8_t*) 0x6000, _bootfriend_bin, _bootfriend_bin_size);
+	copy_to_iram((void*) 0x6000, _bootfriend_bin, _bootfriend_bin_size);
 
 	uint8_t vbl_bootstrap[12];
 	vbl_bootstrap[0] = 0x50; // PUSH AX
@@ -146,11 +158,7 @@ static void test_bootfriend(void) {
 	// prepare UI
     outportb(IO_SCR_BASE, SCR1_BASE(0x0800));
 	for (uint8_t i = 0; i <= 42; i++) {
-		const uint8_t __far *src = _font_default_bin + (ws_ieep_internal_owner_to_ascii_map[i] * 8);
-		uint16_t *dst = (uint16_t*) (0x2000 + (i * 16));
-		for (int i = 0; i < _font_default_bin_size; i++) {
-			*(dst++) = *(src++);
-		}
+		copy_to_iram((void*) (0x2000 + (i * 16)), _font_default_bin + (ws_ieep_internal_owner_to_ascii_map[i] * 16), 16);
 	}
 
 	cpu_irq_disable();
@@ -179,94 +187,149 @@ static void test_bootfriend(void) {
 
 static const char IN_ROM msg_are_you_sure_install[] = "THIS SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND.\n\nWould you like to install?";
 static const char IN_ROM msg_installing_eeprom_data[] = "Installing IEEPROM data...";
-static const char IN_ROM msg_verifying_eeprom_data[] =  "Verifying IEEPROM data....";
 static const char IN_ROM msg_backing_up_eeprom[] = "Backing up IEEPROM...";
 static const char IN_ROM msg_verify_error[] =  "Verify error @ %03X";
+static const char IN_ROM msg_words_written[] = "Words written: %d";
+static const char IN_ROM msg_words_skipped[] = "Words unchanged: %d";
+static const char IN_ROM msg_words_retried[] = "Write retries: %d";
 static const char IN_ROM msg_do_not_turn_off[] = "Do not turn off the console!";
 static const char IN_ROM msg_none[] = "";
 
-static void install_bootfriend(const uint8_t __far* data, uint16_t data_size) {
-	ws_eeprom_handle_t ieep_handle = ws_eeprom_handle_internal();
+typedef struct {
+	uint16_t words_written;
+	uint16_t words_skipped;
+	uint16_t words_retried;
+	uint16_t error_offset;
+	// progress bar: words expected to be written, or 0 if not known
+	uint16_t words_to_write;
+	uint8_t step_counter;
+} install_state_t;
+
+#define INSTALL_NO_ERROR 0xFFFF
+
+// The installation in progress, for install_word_done().
+static install_state_t *install_state;
+
+static bool install_word_allowed(uint16_t i, uint16_t w) {
+	// skip invalid colors
+	if (i == 4 && (w & 0xFF) >= 0x10) return false;
+	// skip SwanCrystal data block
+	if (i >= 0x2C && i < 0x38) return false;
+	return true;
+}
+
+// Called by the IEEPROM write queue, possibly from the VBlank interrupt.
+static void install_word_done(uint16_t address, uint8_t writes) {
+	install_state_t *state = install_state;
+
+	if (writes == IEEP_SHADOW_WRITE_FAILED) {
+		if (state->error_offset == INSTALL_NO_ERROR) {
+			state->error_offset = address - 0x80;
+		}
+		return;
+	}
+	state->words_written++;
+	state->words_retried += writes - 1;
+
+	if (state->words_to_write != 0) {
+		while (state->step_counter < 26 && state->words_written * 26 >= (state->step_counter + 1) * state->words_to_write) {
+			SCREEN1[1 + (state->step_counter++) + (15 << 5)] = SCR_ENTRY_PALETTE(COLOR_SELECTED);
+		}
+	}
+}
+
+static void install_begin(install_state_t *state) {
+	state->words_written = 0;
+	state->words_skipped = 0;
+	state->words_retried = 0;
+	state->error_offset = INSTALL_NO_ERROR;
+	state->words_to_write = 0;
+	state->step_counter = 0;
+	install_state = state;
+	ieep_shadow_set_callback(install_word_done);
+	trace_begin(TRACE_INSTALL);
 
 	ui_puts(1, 3, COLOR_BLACK, msg_installing_eeprom_data);
 	ui_puts(0, 5, COLOR_RED, msg_do_not_turn_off);
 
-	cpu_irq_disable();
-
 	// Disable the custom splash, if enabled.
-	uint16_t word_0x82 = ws_eeprom_read_word(ieep_handle, 0x82);
+	uint16_t word_0x82 = ieep_shadow_read_word(0x82);
 	if (word_0x82 & (IEEP_C_OPTIONS1_CUSTOM_SPLASH << 8)) {
 		word_0x82 ^= (IEEP_C_OPTIONS1_CUSTOM_SPLASH << 8);
-		ws_eeprom_write_word(ieep_handle, 0x82, word_0x82);
+		if (ieep_shadow_write_word(0x82, word_0x82) == IEEP_SHADOW_WRITE_FAILED) {
+			state->error_offset = 0x02;
+		}
 	}
+}
 
-	// Write BootFriend data; skip sensitive/user-configurable areas
-	uint16_t steps_per_progress = (data_size - 4) / (26 * 2);
-	uint8_t step_counter = 0;
-	uint16_t step_counter_min = 0;
+/**
+ * Queue the word at offset i of the splash for installation. Every written
+ * word is read back, so no separate verify pass is needed.
+ * Returns false once a write has failed.
+ */
+static bool install_word(install_state_t *state, uint16_t i, uint16_t w) {
+	if (state->error_offset != INSTALL_NO_ERROR) return false;
+	// skip sensitive/user-configurable areas
+	if (!install_word_allowed(i, w)) return true;
 
-	for (uint16_t i = 0x04; i < data_size; i += 2) {
-		// skip invalid colors
-		if (i == 4 && data[i] >= 0x10) continue;
-
-		// skip SwanCrystal data block
-		if (!(i >= 0x2C && i < 0x38)) {
-			uint16_t w = *((const uint16_t __far*) (data + i));
-			uint16_t w2 = ws_eeprom_read_word(ieep_handle, i + 0x80);
-			if (w != w2) {
-				ws_eeprom_write_word(ieep_handle, i + 0x80, w);
-			}
-		}
+	if (!ieep_shadow_queue_word(i + 0x80, w)) {
+		state->words_skipped++;
+	}
+	return true;
+}
 
-		if (step_counter < 26 && (++step_counter_min) == steps_per_progress) {
-			SCREEN1[1 + (step_counter++) + (15 << 5)] = SCR_ENTRY_PALETTE(COLOR_SELECTED);
-			step_counter_min = 0;
+/**
+ * Re-enable the custom splash, unless the installation failed, and show
+ * a summary.
+ */
+static void install_finish(install_state_t *state, bool success) {
+	ieep_shadow_flush();
+	ieep_shadow_set_callback(NULL);
+	trace_end(TRACE_INSTALL);
+
+	if (success && state->error_offset == INSTALL_NO_ERROR) {
+		uint16_t word_0x82 = ieep_shadow_read_word(0x82) | (IEEP_C_OPTIONS1_CUSTOM_SPLASH << 8);
+		if (ieep_shadow_write_word(0x82, word_0x82) == IEEP_SHADOW_WRITE_FAILED) {
+			state->error_offset = 0x02;
 		}
 	}
 
-	// Verify read.
-	ui_puts(1, 3, COLOR_BLACK, msg_verifying_eeprom_data);
-	ui_clear_lines(15, 15);
+	ui_clear_lines(3, 16);
 
-	step_counter = 0;
-	step_counter_min = 0;
+	ui_printf(1, 7, COLOR_BLACK, msg_words_written, state->words_written);
+	ui_printf(1, 8, COLOR_BLACK, msg_words_skipped, state->words_skipped);
+	ui_printf(1, 9, COLOR_BLACK, msg_words_retried, state->words_retried);
+	if (state->error_offset != INSTALL_NO_ERROR) {
+		ui_printf(1, 11, COLOR_RED, msg_verify_error, state->error_offset);
+	}
+	wait_for_keypress();
+	ui_clear_lines(3, 16);
 
-	for (uint16_t i = 0x04; i < data_size; i += 2) {
-		// skip invalid colors
-		if (i == 4 && data[i] >= 0x10) continue;
-
-		// skip SwanCrystal data block
-		if (!(i >= 0x2C && i < 0x38)) {
-			uint16_t w = *((const uint16_t __far*) (data + i));
-			uint16_t w2 = ws_eeprom_read_word(ieep_handle, i + 0x80);
-			if (w != w2) {
-				ui_clear_lines(15, 15);
-
-				ui_printf(1, 15, COLOR_RED, msg_verify_error, i);
-				cpu_irq_enable();
-				wait_for_keypress();
+	boot_header_mark_changed();
+	statusbar_update();
+}
 
-				goto EndInstall;
-			}
-		}
+static void install_bootfriend(const uint8_t __far* data, uint16_t data_size) {
+	install_state_t state;
+
+	install_begin(&state);
 
-		if (step_counter < 26 && (++step_counter_min) == steps_per_progress) {
-			SCREEN1[1 + (step_counter++) + (15 << 5)] = SCR_ENTRY_PALETTE(COLOR_SELECTED);
-			step_counter_min = 0;
+	// Count the words which differ, so that the progress bar follows
+	// the actual write work.
+	for (uint16_t i = 0x04; i < data_size; i += 2) {
+		uint16_t w = *((const uint16_t __far*) (data + i));
+		if (install_word_allowed(i, w) && w != ieep_shadow_read_word(i + 0x80)) {
+			state.words_to_write++;
 		}
 	}
 
-	// Enable the custom splash.
-	word_0x82 |= (IEEP_C_OPTIONS1_CUSTOM_SPLASH << 8);
-	ws_eeprom_write_word(ieep_handle, 0x82, word_0x82);
-	
-
-EndInstall:
-	cpu_irq_enable();
-	ui_clear_lines(3, 16);
+	// The writes are made in the background; interrupts stay enabled, so
+	// the progress bar keeps moving.
+	for (uint16_t i = 0x04; i < data_size; i += 2) {
+		if (!install_word(&state, i, *((const uint16_t __far*) (data + i)))) break;
+	}
 
-	boot_header_mark_changed();
-	statusbar_update();
+	install_finish(&state, true);
 }
 
 static const char IN_ROM msg_are_you_sure_recovery[] = "THIS SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND.\n\nThis option tries to restore factory TFT configuration for SwanCrystal consoles.\n\nWould you like to continue?";
@@ -275,14 +338,9 @@ static const uint8_t IN_ROM swancrystal_factory_tft_data[] = {
 };
 
 static void recovery_swancrystal(void) {
-	ws_eeprom_handle_t ieep_handle = ws_eeprom_handle_internal();
-
 	for (uint8_t i = 0; i < 8; i += 2) {
 		uint16_t w = *((uint16_t __far*) (swancrystal_factory_tft_data + i));
-		uint16_t w2 = ws_eeprom_read_word(ieep_handle, 0xAE + i);
-		if (w != w2) {
-			ws_eeprom_write_word(ieep_handle, 0xAE + i, w);
-		}
+		ieep_shadow_write_word(0xAE + i, w);
 	}
 
 	boot_header_mark_changed();
@@ -323,6 +381,13 @@ static const char IN_ROM msg_backup_xmodem[] = "Backup IEEPROM (XMODEM)";
 static const char IN_ROM msg_exit[] = "Exit";
 #else
 static const char IN_ROM msg_restore_sram_backup[] = "Restore IEEPROM (SRAM)";
+#ifdef DEV
+static const char IN_ROM msg_store_bfb[] = "Store .bfb to SRAM (XMODEM)";
+#endif
+static const char IN_ROM msg_send_trace[] = "Send timing trace (XMODEM)";
+#ifdef PROFILE
+static const char IN_ROM msg_send_profile[] = "Send profile (XMODEM)";
+#endif
 #endif
 
 uint8_t menu_show_main(void) {
@@ -336,7 +401,7 @@ uint8_t menu_show_main(void) {
 	ws_boot_splash_header_t __far* sram_header = (ws_boot_splash_header_t __far*) MK_FP(0x1000, 0x0080);
 	bool sram_splash_valid = ws_boot_splash_is_header_valid(sram_header);
 
-	menu_entry_t entries[8];
+	menu_entry_t entries[11];
 	uint8_t entry_count = 0;
 
 	entries[entry_count].text = msg_test_bootfriend;
@@ -363,6 +428,16 @@ uint8_t menu_show_main(void) {
 #else
 	entries[entry_count].text = msg_restore_sram_backup;
 	entries[entry_count++].flags = sram_splash_valid ? 0 : MENU_ENTRY_DISABLED;
+#ifdef DEV
+	entries[entry_count].text = msg_store_bfb;
+	entries[entry_count++].flags = 0;
+#endif
+	entries[entry_count].text = msg_send_trace;
+	entries[entry_count++].flags = 0;
+#ifdef PROFILE
+	entries[entry_count].text = msg_send_profile;
+	entries[entry_count++].flags = 0;
+#endif
 #endif
 
 	uint8_t result = ui_menu_run(entries, entry_count, 3 + ((14 - entry_count) >> 1));
@@ -376,7 +451,6 @@ void xmodem_backup(void);
 
 void do_backup_check(void) {
 #ifndef __WONDERFUL_WWITCH__
-	ws_eeprom_handle_t ieep_handle = ws_eeprom_handle_internal();
 	ws_boot_splash_header_t __far* provided_header = (ws_boot_splash_header_t __far*) MK_FP(0x1000, 0x0080);
 
 	input_wait_clear();
@@ -389,7 +463,7 @@ void do_backup_check(void) {
 			ui_puts(1, 3, COLOR_BLACK, msg_backing_up_eeprom);
 			uint16_t __far *sram_ptr = (uint16_t __far*) MK_FP(0x1000, 0x0000);
 			for (uint16_t i = 0; i < 2048; i += 2) {
-				*(sram_ptr++) = ws_eeprom_read_word(ieep_handle, i);
+				*(sram_ptr++) = ieep_shadow_read_word(i);
 			}
 			ui_clear_lines(3, 3);
 		}
@@ -410,32 +484,27 @@ static void xmodem_status(const char __far *str) {
 }
 
 void xmodem_backup(void) {
-	ws_eeprom_handle_t ieep_handle = ws_eeprom_handle_internal();
-	uint8_t xm_buffer[2048];
-
 	ui_clear_lines(3, 17);
-	for (uint16_t ip = 0; ip < 2048; ip += 2) {
-		*((uint16_t __far*) (xm_buffer + ip)) = ws_eeprom_read_word(ieep_handle, ip);
-	}
 	xmodem_status(msg_xmodem_init);
 	xmodem_open(SERIAL_BAUD_38400);
 
         if (xmodem_send_start() == XMODEM_OK) {
-#ifndef __WONDERFUL_WWITCH__
-                cpu_irq_disable();
-#endif
                 xmodem_status(msg_xmodem_progress);
-                for (uint16_t ib = 0; ib < 16; ib++) {
-                        uint8_t result = xmodem_send_block(xm_buffer + (ib << 7));
+                // Send what the chip holds, not what the shadow thinks it
+                // holds; each block is re-read while the previous one is
+                // waiting for its ACK.
+                ieep_shadow_load_range(0, XMODEM_BLOCK_SIZE);
+                for (uint16_t ip = 0; ip < IEEP_SHADOW_SIZE; ip += XMODEM_BLOCK_SIZE) {
+                        xmodem_send_block_start(ieep_shadow + ip, XMODEM_BLOCK_SIZE);
+                        if ((ip + XMODEM_BLOCK_SIZE) < IEEP_SHADOW_SIZE) {
+                                ieep_shadow_load_range(ip + XMODEM_BLOCK_SIZE, XMODEM_BLOCK_SIZE);
+                        }
+                        uint8_t result = xmodem_send_block_finish();
                         switch (result) {
                         case XMODEM_OK:
                                break;
                         case XMODEM_ERROR:
                                xmodem_status(msg_xmodem_transfer_error);
-#ifndef __WONDERFUL_WWITCH__
-                               ws_hwint_ack(0xFF);
-                               cpu_irq_enable();
-#endif
 				wait_for_keypress();
                         case XMODEM_SELF_CANCEL:
                         case XMODEM_CANCEL:
@@ -445,87 +514,301 @@ void xmodem_backup(void) {
                 xmodem_send_finish();
         }
 End:
-#ifndef __WONDERFUL_WWITCH__
-        ws_hwint_ack(0xFF);
-        cpu_irq_enable();
-#endif
         xmodem_close();
         ui_clear_lines(3, 17);
 }
 
+// The part of a restored file which can tell a splash from an IEEPROM backup.
+#define RESTORE_LAYOUT_SIZE (0x80 + sizeof(ws_boot_splash_header_t))
+
+/**
+ * Queue the words of a restored block, at file offset position, which
+ * belong to the splash at file offset splash_offset.
+ */
+static void xmodem_restore_install(install_state_t *state, const uint8_t *block, uint16_t length, uint16_t position, uint16_t splash_offset) {
+	for (uint16_t i = 0; i < length; i += 2) {
+		uint16_t offset = position + i;
+		if (offset < splash_offset + 0x04) continue;
+		offset -= splash_offset;
+		if (offset >= 1920) break;
+		if (!install_word(state, offset, *((const uint16_t*) (block + i)))) return;
+	}
+}
+
 void xmodem_restore(void) {
-	uint8_t xm_buffer[2048];
+	uint8_t xm_buffer[XMODEM_BLOCK_SIZE_1K];
+	// file offset of the next block
 	uint16_t xm_position = 0;
+	// bytes held in xm_buffer, from file offset 0, while the layout is unknown
+	uint16_t xm_buffered = 0;
+	// file offset of the splash, or 0xFFFF if not yet known
+	uint16_t splash_offset = 0xFFFF;
+	const char __far *error = NULL;
+	install_state_t state;
+	uint8_t step_counter = 0;
+
+	ui_clear_lines(3, 17);
+	xmodem_open(SERIAL_BAUD_38400);
+
+        xmodem_status(msg_xmodem_progress);
+        xmodem_recv_start();
+        while (1) {
+                uint16_t xm_length = sizeof(xm_buffer) - xm_buffered;
+                if (xm_length > 2048 - xm_position) xm_length = 2048 - xm_position;
+                uint8_t result = xmodem_recv_block(xm_buffer + xm_buffered, &xm_length);
+                switch (result) {
+                case XMODEM_OK:
+                        break;
+                case XMODEM_COMPLETE:
+                        goto End;
+                case XMODEM_ERROR:
+                        error = msg_xmodem_transfer_error;
+                        goto End;
+                case XMODEM_SELF_CANCEL:
+                case XMODEM_CANCEL:
+                        if (splash_offset == 0xFFFF) {
+                                xmodem_close();
+                                ui_clear_lines(3, 17);
+                                return;
+                        }
+                        error = msg_xmodem_transfer_error;
+                        goto End;
+                }
+
+                // A 128-byte block fits in the serial RX buffer, so the next
+                // one can arrive while this one is being written. A 1K block
+                // does not; the sender has to wait for it to be written.
+                bool ack_early = xm_length <= XMODEM_BLOCK_SIZE;
+                const uint8_t *block = xm_buffer + xm_buffered;
+                uint16_t block_position = xm_position;
+                xm_position += xm_length;
+
+                if (splash_offset == 0xFFFF) {
+                        xm_buffered += xm_length;
+                        if (xm_buffered < RESTORE_LAYOUT_SIZE) {
+                                xmodem_recv_ack();
+                                continue;
+                        }
+
+                        // An IEEPROM backup holds the splash at 0x80; a
+                        // plain splash starts at 0. As before, 0x80 wins
+                        // if both look valid.
+                        if (ws_boot_splash_is_header_valid((ws_boot_splash_header_t __far*) (xm_buffer + 0x80))) {
+                                splash_offset = 0x80;
+                        } else if (ws_boot_splash_is_header_valid((ws_boot_splash_header_t __far*) xm_buffer)) {
+                                splash_offset = 0;
+                        } else {
+                                xmodem_recv_cancel();
+                                xmodem_close();
+                                xmodem_status(msg_restore_invalid_contents);
+                                wait_for_keypress();
+                                ui_clear_lines(3, 17);
+                                return;
+                        }
+
+                        install_begin(&state);
+                        block = xm_buffer;
+                        block_position = 0;
+                        xm_length = xm_buffered;
+                        xm_buffered = 0;
+                }
+
+                if (ack_early) xmodem_recv_ack();
+                xmodem_restore_install(&state, block, xm_length, block_position, splash_offset);
+                ieep_shadow_flush();
+                if (state.error_offset != INSTALL_NO_ERROR) {
+                        xmodem_recv_cancel();
+                        goto End;
+                }
+                if (!ack_early) xmodem_recv_ack();
+
+                while (step_counter < ((xm_position * 13) >> 10)) {
+                        SCREEN1[1 + (step_counter++) + (15 << 5)] = SCR_ENTRY_PALETTE(COLOR_SELECTED);
+                }
+        }
+
+End:
+        xmodem_close();
+
+	// A splash is at most 1920 bytes, or padded to 2048; an IEEPROM
+	// backup is always 2048 bytes.
+	if (error == NULL) {
+		if (splash_offset == 0xFFFF) {
+			error = msg_restore_invalid_contents;
+		} else if (state.error_offset == INSTALL_NO_ERROR
+			&& xm_position != 2048 && (splash_offset != 0 || xm_position > 1920)) {
+			error = msg_restore_invalid_size;
+		}
+	}
+
+	if (splash_offset == 0xFFFF) {
+		// nothing was written
+		ui_clear_lines(3, 17);
+		xmodem_status(error);
+		wait_for_keypress();
+		ui_clear_lines(3, 17);
+		return;
+	}
+
+	if (error != NULL) {
+		ui_clear_lines(3, 16);
+		xmodem_status(error);
+		wait_for_keypress();
+	}
+	install_finish(&state, error == NULL);
+}
+
+#if defined(DEV) && !defined(__WONDERFUL_WWITCH__)
+static const char IN_ROM msg_store_bfb_check[] = "This overwrites the start of cartridge SRAM, including any IEEPROM backup. Continue?";
+static const char IN_ROM msg_store_bfb_done[] = "Hold Y4 on power-on to boot";
+static const char IN_ROM msg_sram_too_small[] = "Cartridge SRAM too small";
+
+// BootFriend boots a .bfb file from the start of SRAM bank 0 when Y4 is
+// held; it loads at most this much of it, header included.
+#define SRAM_BFB_MAX_SIZE (0xFE00 - 0x6800 + 4)
+// ... plus the final block's padding
+#define SRAM_BFB_CAPACITY ((SRAM_BFB_MAX_SIZE + XMODEM_BLOCK_SIZE_1K - 1) & ~(XMODEM_BLOCK_SIZE_1K - 1))
+// bytes compared after the transfer, to catch SRAM too small to hold it
+#define SRAM_BFB_CHECK_SIZE 16
+
+/**
+ * @return Whether BootFriend would load this .bfb header from SRAM.
+ */
+static bool sram_bfb_header_valid(const uint8_t __far *data) {
+	if (data[0] != 'b' || data[1] != 'F') return false;
+	uint16_t address = data[2] | (data[3] << 8);
+	return address == 0xFFFF || (address >= 0x6800 && address < 0xFE00);
+}
+
+void xmodem_store_bfb(void) {
+	uint8_t __far *sram = (uint8_t __far*) MK_FP(0x1000, 0x0000);
+	uint8_t header[SRAM_BFB_CHECK_SIZE];
+	uint16_t xm_position = 0;
+	const char __far *error = NULL;
+	uint8_t step_counter = 0;
+
+	outportb(IO_BANK_RAM, 0);
 
 	ui_clear_lines(3, 17);
 	xmodem_open(SERIAL_BAUD_38400);
 
-#ifndef __WONDERFUL_WWITCH__
-        cpu_irq_disable();
-#endif
         xmodem_status(msg_xmodem_progress);
-        {
-                xmodem_recv_start();
-                for (uint16_t ib = 0; ib < 16; ib++) {
-                        uint8_t result = xmodem_recv_block(xm_buffer + xm_position);
-			xm_position += 128;
-                        xmodem_recv_ack();
+        xmodem_recv_start();
+        while (1) {
+                uint16_t xm_length = SRAM_BFB_CAPACITY - xm_position;
+                if (xm_length > XMODEM_BLOCK_SIZE_1K) xm_length = XMODEM_BLOCK_SIZE_1K;
+                uint8_t result = xmodem_recv_block(sram + xm_position, &xm_length);
+                switch (result) {
+                case XMODEM_OK:
+                        break;
+                case XMODEM_COMPLETE:
+                        goto End;
+                case XMODEM_ERROR:
+                case XMODEM_SELF_CANCEL:
+                case XMODEM_CANCEL:
+                        error = msg_xmodem_transfer_error;
+                        goto End;
+                }
+
+                if (xm_position == 0) {
+                        if (!sram_bfb_header_valid(sram)) {
+                                xmodem_recv_cancel();
+                                error = msg_restore_invalid_contents;
+                                goto End;
+                        }
+                        for (uint8_t i = 0; i < SRAM_BFB_CHECK_SIZE; i++) header[i] = sram[i];
+                }
+                xm_position += xm_length;
+                xmodem_recv_ack();
+
+                while (step_counter < (uint8_t) (((uint32_t) xm_position * 26) / SRAM_BFB_CAPACITY)) {
+                        SCREEN1[1 + (step_counter++) + (15 << 5)] = SCR_ENTRY_PALETTE(COLOR_SELECTED);
+                }
+        }
+
+End:
+        xmodem_close();
+
+	if (error == NULL) {
+		if (xm_position == 0) {
+			error = msg_restore_invalid_contents;
+		} else {
+			// smaller SRAM wraps around, over the start of the file
+			for (uint8_t i = 0; i < SRAM_BFB_CHECK_SIZE; i++) {
+				if (header[i] != sram[i]) error = msg_sram_too_small;
+			}
+		}
+	}
+	if (error != NULL) {
+		// don't leave part of a file behind for BootFriend to boot
+		sram[0] = 0;
+	}
+
+	ui_clear_lines(3, 17);
+	xmodem_status(error != NULL ? error : msg_store_bfb_done);
+	wait_for_keypress();
+	ui_clear_lines(3, 17);
+}
+#endif
+
+#ifndef __WONDERFUL_WWITCH__
+typedef void (*dump_read_t)(uint8_t *buffer, uint16_t offset, uint16_t length);
+
+static void xmodem_send_dump(uint16_t size, dump_read_t read) {
+	uint8_t xm_buffer[XMODEM_BLOCK_SIZE];
+
+	ui_clear_lines(3, 17);
+	xmodem_status(msg_xmodem_init);
+	xmodem_open(SERIAL_BAUD_38400);
+
+        if (xmodem_send_start() == XMODEM_OK) {
+                xmodem_status(msg_xmodem_progress);
+                for (uint16_t ip = 0; ip < size; ip += XMODEM_BLOCK_SIZE) {
+                        read(xm_buffer, ip, XMODEM_BLOCK_SIZE);
+                        uint8_t result = xmodem_send_block(xm_buffer, XMODEM_BLOCK_SIZE);
                         switch (result) {
                         case XMODEM_OK:
                                break;
-			case XMODEM_COMPLETE:
-				goto End;
                         case XMODEM_ERROR:
-                               xm_position = 0;
                                xmodem_status(msg_xmodem_transfer_error);
-#ifndef __WONDERFUL_WWITCH__
-                               ws_hwint_ack(0xFF);
-                               cpu_irq_enable();
-#endif
 				wait_for_keypress();
-				ui_clear_lines(3, 17);
-				return;
                         case XMODEM_SELF_CANCEL:
                         case XMODEM_CANCEL:
-#ifndef __WONDERFUL_WWITCH__
-                               ws_hwint_ack(0xFF);
-                               cpu_irq_enable();
-#endif
-				ui_clear_lines(3, 17);
-				return;
+                               goto End;
                         }
                 }
+                xmodem_send_finish();
         }
-
 End:
-#ifndef __WONDERFUL_WWITCH__
-        ws_hwint_ack(0xFF);
-        cpu_irq_enable();
-#endif
         xmodem_close();
         ui_clear_lines(3, 17);
+}
 
-        // verify and install
-	uint8_t __far* data_ptr = xm_buffer;
-	uint16_t data_size = 1920;
-	if (xm_position == 2048) {
-		data_ptr += 0x80;
-	} else if (xm_position > 1920) {
-		xmodem_status(msg_restore_invalid_size);
-		wait_for_keypress();
-		return;
-	} else {
-		data_size = xm_position;
-	}
-
-	if (!ws_boot_splash_is_header_valid(data_ptr)) {
-		xmodem_status(msg_restore_invalid_contents);
-		wait_for_keypress();
-		return;
-	}
+void xmodem_send_trace(void) {
+	// keep the trace as it was when the menu item was chosen
+	trace_set_enabled(false);
+	xmodem_send_dump(trace_dump_size(), trace_read);
+	trace_set_enabled(true);
+}
 
-	install_bootfriend(data_ptr, data_size);
+#ifdef PROFILE
+void xmodem_send_profile(void) {
+	// don't profile the transfer itself; start over once it is done
+	profile_stop();
+	xmodem_send_dump(profile_dump_size(), profile_read);
+	profile_reset();
+	profile_start();
 }
+#endif
+#endif
+
+// Store .bfb to SRAM is only shown by the DEV installer.
+#ifdef DEV
+#define MENU_STORE_BFB 8
+#define MENU_SEND_TRACE 9
+#else
+#define MENU_SEND_TRACE 8
+#endif
 
 void menu_main(void) {
 	input_wait_clear();
@@ -565,25 +848,43 @@ void menu_main(void) {
 			install_bootfriend(MK_FP(0x1000, 0x0080), 2048 - 0x80);
 		}
 		break;
+#ifdef DEV
+	case MENU_STORE_BFB: // Store .bfb to SRAM
+		if (menu_confirm(msg_store_bfb_check, 4, false, false)) {
+			xmodem_store_bfb();
+		}
+		break;
+#endif
+	case MENU_SEND_TRACE: // Timing trace
+		xmodem_send_trace();
+		break;
+#ifdef PROFILE
+	case MENU_SEND_TRACE + 1: // Profile
+		xmodem_send_profile();
+		break;
+#endif
 #endif
 	}
 }
 
 int main(void) {
 #ifndef __WONDERFUL_WWITCH__
+	// VBlank first, so that vbl_ticks can time the startup
 	cpu_irq_disable();
+	outportb(IO_HWINT_ACK, 0xFF);
+	ws_hwint_set_handler(HWINT_IDX_VBLANK, vblank_int_handler);
+	ws_hwint_enable(HWINT_VBLANK);
+	cpu_irq_enable();
 #endif
+	profile_start();
+	trace_begin(TRACE_STARTUP);
 
+	ieep_shadow_load();
 	boot_header_mark_changed();
 	ui_init();
 	statusbar_update();
 
-#ifndef __WONDERFUL_WWITCH__
-	outportb(IO_HWINT_ACK, 0xFF);
-	ws_hwint_set_handler(HWINT_IDX_VBLANK, vblank_int_handler);
-	ws_hwint_enable(HWINT_VBLANK);
-	cpu_irq_enable();
-#endif
+	trace_end(TRACE_STARTUP);
 
 	while(1) {
 		menu_main();
@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <wonderful.h>
+#ifndef __WONDERFUL_WWITCH__
+#include <ws.h>
+#endif
+#include "profile.h"
+
+#if defined(PROFILE) && !defined(__WONDERFUL_WWITCH__)
+
+#define TIMER_PORT_CTRL 0xA2
+#define TIMER_PORT_HBLANK_RELOAD 0xA4
+#define TIMER_HBLANK_ENABLE 0x01
+#define TIMER_HBLANK_REPEAT 0x02
+
+#define PROFILE_HEADER_SIZE 20
+
+// Updated by profile_int_handler.
+uint16_t profile_histogram[PROFILE_BUCKETS];
+uint32_t profile_samples;
+uint32_t profile_other;
+
+extern void profile_int_handler(void);
+
+void profile_start(void) {
+	ws_hwint_set_handler(HWINT_IDX_HBLANK_TIMER, profile_int_handler);
+	outportw(TIMER_PORT_HBLANK_RELOAD, PROFILE_PERIOD);
+	outportb(TIMER_PORT_CTRL, inportb(TIMER_PORT_CTRL) | TIMER_HBLANK_ENABLE | TIMER_HBLANK_REPEAT);
+	ws_hwint_ack(HWINT_HBLANK_TIMER);
+	ws_hwint_enable(HWINT_HBLANK_TIMER);
+}
+
+void profile_stop(void) {
+	ws_hwint_disable(HWINT_HBLANK_TIMER);
+	outportb(TIMER_PORT_CTRL, inportb(TIMER_PORT_CTRL) & ~(TIMER_HBLANK_ENABLE | TIMER_HBLANK_REPEAT));
+	ws_hwint_ack(HWINT_HBLANK_TIMER);
+}
+
+void profile_reset(void) {
+	cpu_irq_disable();
+	memset(profile_histogram, 0, sizeof(profile_histogram));
+	profile_samples = 0;
+	profile_other = 0;
+	cpu_irq_enable();
+}
+
+uint16_t profile_dump_size(void) {
+	return PROFILE_HEADER_SIZE + sizeof(profile_histogram);
+}
+
+void profile_read(uint8_t *buffer, uint16_t offset, uint16_t length) {
+	uint8_t header[PROFILE_HEADER_SIZE];
+	uint16_t code_segment;
+	__asm volatile ("mov %%cs, %0" : "=r" (code_segment));
+
+	// magic, version, bucket shift, bucket count, code segment,
+	// samples in total, samples outside of the code segment,
+	// sampling period in lines
+	header[0] = 'b';
+	header[1] = 'P';
+	header[2] = PROFILE_DUMP_VERSION;
+	header[3] = PROFILE_SHIFT;
+	header[4] = PROFILE_BUCKETS & 0xFF;
+	header[5] = PROFILE_BUCKETS >> 8;
+	header[6] = code_segment & 0xFF;
+	header[7] = code_segment >> 8;
+	memcpy(header + 8, &profile_samples, 4);
+	memcpy(header + 12, &profile_other, 4);
+	header[16] = PROFILE_PERIOD & 0xFF;
+	header[17] = PROFILE_PERIOD >> 8;
+	header[18] = 0;
+	header[19] = 0;
+
+	for (uint16_t i = 0; i < length; i++, offset++) {
+		uint8_t value = 0x1A;
+		if (offset < PROFILE_HEADER_SIZE) {
+			value = header[offset];
+		} else if (offset < profile_dump_size()) {
+			value = ((const uint8_t*) profile_histogram)[offset - PROFILE_HEADER_SIZE];
+		}
+		buffer[i] = value;
+	}
+}
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+#pragma once
+
+#include <stdint.h>
+
+// PC-sampling profiler, built with "make -f Makefile.rom PROFILE=1". The
+// HBlank timer interrupts the CPU every PROFILE_PERIOD lines; each sample
+// of the interrupted IP within the installer's code segment counts towards
+// a histogram of (IP >> PROFILE_SHIFT) buckets. tools/bfprof.py maps the
+// histogram back to functions using the .elf file.
+//
+// Samples are taken with interrupts enabled only: time spent in interrupt
+// handlers or with interrupts disabled is attributed to the instruction
+// which follows it.
+
+// Keep in sync with profile_handler.s
+#define PROFILE_SHIFT 6
+#define PROFILE_BUCKETS (0x10000 >> PROFILE_SHIFT)
+
+// 7 lines (about 1.7 kHz) does not divide a 159-line frame, so that the
+// samples do not lock on to code synchronized to the display
+#define PROFILE_PERIOD 7
+
+// Dump format: a 20-byte header, then PROFILE_BUCKETS little-endian
+// 16-bit counters; see profile_read().
+#define PROFILE_DUMP_VERSION 1
+
+#if defined(PROFILE) && !defined(__WONDERFUL_WWITCH__)
+void profile_start(void);
+void profile_stop(void);
+void profile_reset(void);
+
+/**
+ * @return The size of a dump of the histogram, in bytes.
+ */
+uint16_t profile_dump_size(void);
+
+/**
+ * Copy length bytes of a dump of the histogram, starting at offset, into
+ * buffer. Bytes past the end of the dump are filled with 0x1A.
+ */
+void profile_read(uint8_t *buffer, uint16_t offset, uint16_t length);
+#else
+static inline void profile_start(void) { }
+static inline void profile_stop(void) { }
+static inline void profile_reset(void) { }
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <wonderful.h>
+
+#if defined(PROFILE) && !defined(__WONDERFUL_WWITCH__)
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+	.global profile_int_handler
+
+// Keep in sync with profile.h
+#define PROFILE_SHIFT 6
+
+profile_int_handler:
+	push bp
+	mov bp, sp
+	push ax
+	push bx
+	push ds
+	push ss
+	pop ds
+
+	add word ptr [profile_samples], 1
+	adc word ptr [profile_samples + 2], 0
+
+	// [bp + 2] = interrupted IP, [bp + 4] = interrupted CS
+	mov ax, cs
+	cmp ax, word ptr [bp + 4]
+	jne 1f
+
+	mov bx, word ptr [bp + 2]
+	shr bx, (PROFILE_SHIFT - 1)
+	and bl, 0xFE
+	// Saturate at 0xFFFF
+	add word ptr [profile_histogram + bx], 1
+	sbb word ptr [profile_histogram + bx], 0
+	jmp 2f
+1:
+	add word ptr [profile_other], 1
+	adc word ptr [profile_other + 2], 0
+2:
+	// The timer also services the IEEPROM write queue; see ieep_shadow.c
+	push cx
+	push dx
+	push es
+	ASM_PLATFORM_CALL ieep_shadow_update
+	pop es
+	pop dx
+	pop cx
+
+	// Acknowledge interrupt
+	mov al, 0x80
+	out 0xB6, al
+
+	pop ds
+	pop bx
+	pop ax
+	pop bp
+	iret
+#endif
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#ifdef __WONDERFUL_WWITCH__
+#include <sys/bios.h>
+#else
+#include <ws.h>
+#endif
+#include "serial.h"
+
+#ifdef __WONDERFUL_WWITCH__
+
+// The WWitch BIOS buffers the serial port on its own.
+
+void serial_open(uint8_t baudrate) {
+	comm_set_baudrate(baudrate ? COMM_SPEED_38400 : COMM_SPEED_9600);
+	comm_open();
+}
+
+void serial_close(void) {
+	comm_close();
+}
+
+int16_t serial_getc_nonblock(void) {
+	return comm_receive_char();
+}
+
+uint8_t serial_getc(void) {
+	int16_t r;
+	while ((r = comm_receive_char()) < 0) { }
+	return r;
+}
+
+void serial_putc(uint8_t value) {
+	comm_send_char(value);
+}
+
+void serial_flush(void) {
+
+}
+
+#else
+
+// Shared with serial_handler.s.
+uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_SIZE];
+volatile uint8_t serial_rx_head, serial_rx_tail;
+uint8_t serial_tx_buffer[SERIAL_TX_BUFFER_SIZE];
+volatile uint8_t serial_tx_head, serial_tx_tail;
+
+extern void serial_rx_int_handler(void);
+extern void serial_tx_int_handler(void);
+
+void serial_open(uint8_t baudrate) {
+	cpu_irq_disable();
+	serial_rx_head = 0;
+	serial_rx_tail = 0;
+	serial_tx_head = 0;
+	serial_tx_tail = 0;
+
+	ws_serial_open(baudrate);
+	ws_hwint_set_handler(HWINT_IDX_SERIAL_RX, serial_rx_int_handler);
+	ws_hwint_set_handler(HWINT_IDX_SERIAL_TX, serial_tx_int_handler);
+	ws_hwint_ack(HWINT_SERIAL_RX | HWINT_SERIAL_TX);
+	ws_hwint_enable(HWINT_SERIAL_RX);
+	cpu_irq_enable();
+}
+
+void serial_close(void) {
+	serial_flush();
+
+	cpu_irq_disable();
+	ws_hwint_disable(HWINT_SERIAL_RX | HWINT_SERIAL_TX);
+	ws_hwint_ack(HWINT_SERIAL_RX | HWINT_SERIAL_TX);
+	cpu_irq_enable();
+
+	while (!ws_serial_is_writable()) { }
+	ws_serial_close();
+}
+
+int16_t serial_getc_nonblock(void) {
+	uint8_t tail = serial_rx_tail;
+	if (tail == serial_rx_head) return -1;
+	uint8_t value = serial_rx_buffer[tail];
+	serial_rx_tail = tail + 1;
+	return value;
+}
+
+// "sti; hlt" cannot be interrupted in between, so no wakeup is missed
+// between checking the ring and halting.
+#define serial_wait_irq() __asm volatile ("sti\nhlt\ncli")
+
+uint8_t serial_getc(void) {
+	int16_t r;
+	cpu_irq_disable();
+	while ((r = serial_getc_nonblock()) < 0) {
+		serial_wait_irq();
+	}
+	cpu_irq_enable();
+	return r;
+}
+
+void serial_putc(uint8_t value) {
+	uint8_t head = serial_tx_head;
+	uint8_t next = (head + 1) & (SERIAL_TX_BUFFER_SIZE - 1);
+	cpu_irq_disable();
+	while (next == serial_tx_tail) {
+		serial_wait_irq();
+	}
+	serial_tx_buffer[head] = value;
+	serial_tx_head = next;
+
+	// The TX handler disables its own interrupt once the ring is empty.
+	ws_hwint_enable(HWINT_SERIAL_TX);
+	cpu_irq_enable();
+}
+
+void serial_flush(void) {
+	cpu_irq_disable();
+	while (serial_tx_tail != serial_tx_head) {
+		serial_wait_irq();
+	}
+	cpu_irq_enable();
+}
+
+#endif
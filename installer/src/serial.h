@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interrupt-driven serial port. RX and TX are buffered in ring buffers
+// filled/drained by the serial IRQ handlers, so interrupts must remain
+// enabled while the port is open.
+//
+// The RX ring size must be 256 (indices wrap naturally); the TX ring size
+// must be a power of two.
+#define SERIAL_RX_BUFFER_SIZE 256
+#define SERIAL_TX_BUFFER_SIZE 64
+
+void serial_open(uint8_t baudrate);
+void serial_close(void);
+
+/**
+ * @return The next received byte, or -1 if none is available.
+ */
+int16_t serial_getc_nonblock(void);
+uint8_t serial_getc(void);
+void serial_putc(uint8_t value);
+
+/**
+ * Wait until all queued bytes have been sent.
+ */
+void serial_flush(void);
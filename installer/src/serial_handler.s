@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <wonderful.h>
+
+#ifndef __WONDERFUL_WWITCH__
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+	.global serial_rx_int_handler
+	.global serial_tx_int_handler
+
+// Keep in sync with serial.h
+#define SERIAL_TX_BUFFER_SIZE 64
+
+serial_rx_int_handler:
+	push ax
+	push bx
+	push ds
+	push ss
+	pop ds
+
+	in al, 0xB1
+	mov bl, byte ptr [serial_rx_head]
+	xor bh, bh
+	mov byte ptr [serial_rx_buffer + bx], al
+	inc bl
+	// Drop the byte if the ring is full
+	cmp bl, byte ptr [serial_rx_tail]
+	je 1f
+	mov byte ptr [serial_rx_head], bl
+1:
+	// Acknowledge interrupt
+	mov al, 0x08
+	out 0xB6, al
+
+	pop ds
+	pop bx
+	pop ax
+	iret
+
+serial_tx_int_handler:
+	push ax
+	push bx
+	push ds
+	push ss
+	pop ds
+
+	mov bl, byte ptr [serial_tx_tail]
+	cmp bl, byte ptr [serial_tx_head]
+	je 2f
+	xor bh, bh
+	mov al, byte ptr [serial_tx_buffer + bx]
+	out 0xB1, al
+	inc bl
+	and bl, (SERIAL_TX_BUFFER_SIZE - 1)
+	mov byte ptr [serial_tx_tail], bl
+	cmp bl, byte ptr [serial_tx_head]
+	jne 1f
+2:
+	// Ring empty - stop TX interrupts until serial_putc() is called
+	in al, 0xB2
+	and al, 0xFE
+	out 0xB2, al
+1:
+	// Acknowledge interrupt
+	mov al, 0x01
+	out 0xB6, al
+
+	pop ds
+	pop bx
+	pop ax
+	iret
+#endif
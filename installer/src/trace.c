@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#ifndef __WONDERFUL_WWITCH__
+#include <ws.h>
+#endif
+#include "trace.h"
+
+#define LINE_PORT_CURRENT 0x02
+#define LINES_PER_FRAME 159
+#define LINE_VBLANK 144
+
+typedef struct {
+	uint16_t ticks;
+	uint8_t line;
+	uint8_t event;
+} trace_entry_t;
+
+static trace_entry_t trace_buffer[TRACE_SIZE];
+static uint8_t trace_head;
+static uint8_t trace_count;
+static bool trace_disabled;
+
+#ifndef __WONDERFUL_WWITCH__
+extern volatile uint16_t vbl_ticks;
+
+void trace_event(uint8_t event) {
+	if (trace_disabled) return;
+
+	// may be called from interrupt handlers
+	__asm volatile ("pushf\ncli" ::: "memory");
+	trace_entry_t *entry = &trace_buffer[trace_head];
+	trace_head = (trace_head + 1) & (TRACE_SIZE - 1);
+	if (trace_count < TRACE_SIZE) trace_count++;
+	entry->ticks = vbl_ticks;
+	entry->line = inportb(LINE_PORT_CURRENT);
+	entry->event = event;
+	__asm volatile ("popf" ::: "memory");
+}
+#endif
+
+void trace_set_enabled(bool enabled) {
+	trace_disabled = !enabled;
+}
+
+uint16_t trace_dump_size(void) {
+	return 8 + trace_count * sizeof(trace_entry_t);
+}
+
+void trace_read(uint8_t *buffer, uint16_t offset, uint16_t length) {
+	uint16_t size = trace_dump_size();
+
+	for (uint16_t i = 0; i < length; i++, offset++) {
+		uint8_t value = 0x1A;
+		if (offset < 8) {
+			// header: magic, version, entry count, frame timing
+			static const uint8_t header_template[8] = {'b', 'T', TRACE_DUMP_VERSION, 0, 0, sizeof(trace_entry_t), LINES_PER_FRAME, LINE_VBLANK};
+			value = header_template[offset];
+			if (offset == 3) value = trace_count;
+		} else if (offset < size) {
+			uint16_t entry_offset = offset - 8;
+			uint8_t index = ((trace_head - trace_count) + (entry_offset / sizeof(trace_entry_t))) & (TRACE_SIZE - 1);
+			value = ((const uint8_t*) &trace_buffer[index])[entry_offset % sizeof(trace_entry_t)];
+		}
+		buffer[i] = value;
+	}
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * BootFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * BootFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with BootFriend. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Phase timing trace. Each event is timestamped with vbl_ticks and the
+// current display line; tools/bftrace.py turns a dump into a table of
+// per-phase latencies.
+
+#define TRACE_SIZE 128
+
+// Phases are traced as a begin event, then the same ID | TRACE_END.
+// Events which are never ended are counted, but not timed.
+#define TRACE_END 0x80
+
+#define TRACE_STARTUP       0x01 /* main() to the first menu */
+#define TRACE_IEEP_LOAD     0x02 /* reading the IEEPROM into the shadow */
+#define TRACE_IEEP_WRITE    0x03 /* one IEEPROM word write */
+#define TRACE_IEEP_VERIFY   0x04 /* reading back a written word */
+#define TRACE_INSTALL       0x05 /* install_begin() to install_finish() */
+#define TRACE_XMODEM_SEND   0x06 /* sending a block, until it is ACKed */
+#define TRACE_XMODEM_RECV   0x07 /* receiving a block */
+#define TRACE_XMODEM_RETRY  0x08 /* a block was NAKed (no end event) */
+#define TRACE_UI_STATUSBAR  0x09 /* redrawing the status bar */
+#define TRACE_UI_MENU       0x0A /* drawing a menu */
+
+// Dump format: an 8-byte header, then TRACE_SIZE entries at most, oldest
+// first; see trace_read().
+#define TRACE_DUMP_VERSION 1
+
+#ifdef __WONDERFUL_WWITCH__
+static inline void trace_event(uint8_t event) { }
+#else
+void trace_event(uint8_t event);
+#endif
+static inline void trace_begin(uint8_t event) { trace_event(event); }
+static inline void trace_end(uint8_t event) { trace_event(event | TRACE_END); }
+
+/**
+ * Stop or resume recording, such as while the trace is being sent.
+ */
+void trace_set_enabled(bool enabled);
+
+/**
+ * @return The size of a dump of the trace, in bytes.
+ */
+uint16_t trace_dump_size(void);
+
+/**
+ * Copy length bytes of a dump of the trace, starting at offset, into buffer.
+ * Bytes past the end of the dump are filled with 0x1A.
+ */
+void trace_read(uint8_t *buffer, uint16_t offset, uint16_t length);
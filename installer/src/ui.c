@@ -27,6 +27,7 @@
 #include "input.h"
 #include "ui.h"
 #include "font_default.h"
+#include "trace.h"
 #include "util.h"
 #include "ws/display.h"
 
@@ -107,11 +108,9 @@ void ui_init(void) {
         font_set_monodata(i, 1, buffer);
     }
 #else
-    const uint8_t __far* src = _font_default_bin;
-    uint16_t __far* dst = (uint16_t __far*) MK_FP(0x0000, 0x2000);
-    for (int i = 0; i < _font_default_bin_size; i++) {
-        *(dst++) = *(src++);
-    }
+    // Color mode first, so that the font can be copied with GDMA.
+    if (ws_system_is_color()) ws_mode_set(WS_MODE_COLOR);
+    copy_to_iram((void*) 0x2000, _font_default_bin, _font_default_bin_size);
 #endif
 
 #ifndef __WONDERFUL_WWITCH__
@@ -137,9 +136,7 @@ void ui_init(void) {
 #endif
     }
 
-#ifndef __WONDERFUL_WWITCH__
-    ws_mode_set(WS_MODE_COLOR);
-#else
+#ifdef __WONDERFUL_WWITCH__
     wwc_set_color_mode(COLOR_MODE_4COLOR);
 #endif
 
@@ -173,9 +170,11 @@ uint8_t ui_menu_run(menu_entry_t __far* entries, uint8_t entry_count, uint8_t y)
     if (curr_entry >= entry_count) return 0xFF;
 
     // draw all menu entries
+    trace_begin(TRACE_UI_MENU);
     for (uint8_t i = 0; i < entry_count; i++) {
         ui_menu_draw_entry(entries + i, y + i, i == curr_entry);
     }
+    trace_end(TRACE_UI_MENU);
 
     while (true) {
         wait_for_vblank();
@@ -19,6 +19,7 @@
 #ifdef __WONDERFUL_WWITCH__
 #include <sys/bios.h>
 #else
+#include <string.h>
 #include <ws.h>
 #endif
 #include "util.h"
@@ -37,3 +38,32 @@ void wait_for_vblank(void) {
         sys_wait(1);
 #endif
 }
+
+#ifndef __WONDERFUL_WWITCH__
+// General-purpose DMA ports (Color only)
+#define GDMA_PORT_SOURCE_L 0x40
+#define GDMA_PORT_SOURCE_H 0x42
+#define GDMA_PORT_DEST     0x44
+#define GDMA_PORT_LENGTH   0x46
+#define GDMA_PORT_CTRL     0x48
+#define GDMA_CTRL_START    0x80
+
+#define SYSTEM_PORT_CTRL2  0x60
+#define SYSTEM_CTRL2_COLOR 0x80
+
+void copy_to_iram(void *dest, const void __far* src, uint16_t length) {
+        // GDMA is only available in Color mode
+        if (!(inportb(SYSTEM_PORT_CTRL2) & SYSTEM_CTRL2_COLOR)) {
+                memcpy(dest, src, length);
+                return;
+        }
+
+        uint32_t linear = (((uint32_t) FP_SEG(src)) << 4) + FP_OFF(src);
+        outportw(GDMA_PORT_SOURCE_L, linear);
+        outportb(GDMA_PORT_SOURCE_H, linear >> 16);
+        outportw(GDMA_PORT_DEST, (uint16_t) dest);
+        outportw(GDMA_PORT_LENGTH, length);
+        // the CPU is halted until the transfer is complete
+        outportb(GDMA_PORT_CTRL, GDMA_CTRL_START);
+}
+#endif
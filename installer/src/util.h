@@ -24,3 +24,11 @@
 #define IN_ROM __wf_rom
 
 void wait_for_vblank(void);
+
+#ifndef __WONDERFUL_WWITCH__
+/**
+ * Copy data from ROM or IRAM to IRAM, using general-purpose DMA where the
+ * console supports it. dest, src and length must be even.
+ */
+void copy_to_iram(void *dest, const void __far* src, uint16_t length);
+#endif
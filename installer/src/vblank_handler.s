@@ -33,6 +33,7 @@ vblank_int_handler:
 
 	inc word ptr [vbl_ticks]
 	ASM_PLATFORM_CALL vblank_input_update
+	ASM_PLATFORM_CALL ieep_shadow_update
 
 	// Acknowledge interrupt
 	mov al, 0x40
@@ -43,4 +44,27 @@ vblank_int_handler:
 	pop ss
 	popa
 	iret
+
+#ifndef PROFILE
+	.global ieep_timer_int_handler
+
+// Services the IEEPROM write queue while it is busy; see ieep_shadow.c.
+ieep_timer_int_handler:
+	pusha
+	push ds
+	push es
+	push ss
+	pop ds
+
+	ASM_PLATFORM_CALL ieep_shadow_update
+
+	// Acknowledge interrupt
+	mov al, 0x80
+	out 0xB6, al
+
+	pop es
+	pop ds
+	popa
+	iret
+#endif
 #endif
@@ -31,15 +31,27 @@
 #else
 #include <ws.h>
 #endif
+#include "serial.h"
+#include "trace.h"
 #include "xmodem.h"
 
 #define SOH 1
+#define STX 2
 #define EOT 4
 #define ACK 6
 #define NAK 21
 #define CAN 24
 
+// NAKs of a 1K block before falling back to 128-byte blocks
+#define XMODEM_1K_RETRIES 3
+
 static uint8_t xmodem_idx;
+static bool xmodem_1k_disabled;
+
+// block being sent, kept for retransmission
+static const uint8_t __far* xmodem_send_ptr;
+static uint16_t xmodem_send_length;
+static uint8_t xmodem_send_retries;
 
 bool xmodem_poll_exit(void) {
 	return false;
@@ -47,159 +59,153 @@ bool xmodem_poll_exit(void) {
 }
 
 void xmodem_open(uint8_t baudrate) {
-#ifdef __WONDERFUL_WWITCH__
-	comm_set_baudrate(baudrate ? COMM_SPEED_38400 : COMM_SPEED_9600);
-	comm_open();
-#else
-	ws_serial_open(baudrate);
-	ws_hwint_set_default_handler_serial_rx();
-#endif
+	serial_open(baudrate);
 }
 
 void xmodem_close(void) {
-#ifdef __WONDERFUL_WWITCH__
-	comm_close();
-#else
-        while (!ws_serial_is_writable()) { }
-	ws_serial_close();
-#endif
+	serial_close();
 }
 
-#ifdef __WONDERFUL_WWITCH__
-#define ws_serial_getc comm_receive_char
-#define ws_serial_putc comm_send_char
-#endif
-
-// call after SOH
-static uint8_t xmodem_read_block(uint8_t __far* block) {
-	uint8_t idx = ws_serial_getc();
+// call after SOH/STX
+static uint8_t xmodem_read_block(uint8_t __far* block, uint16_t length) {
+	uint8_t idx = serial_getc();
 	if (idx != xmodem_idx) {
 		return XMODEM_CANCEL;
 	}
-	uint8_t idx_inv = ws_serial_getc();
+	uint8_t idx_inv = serial_getc();
 	if ((idx ^ 0xFF) != idx_inv) {
 		return XMODEM_CANCEL;
 	}
 
 	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
-		uint8_t v = ws_serial_getc();
+	for (uint16_t i = 0; i < length; i++) {
+		uint8_t v = serial_getc();
 		checksum += v;
 		if (block != NULL) { 
 			block[i] = v;
 		}
 	}
 
-	uint8_t checksum_actual = ws_serial_getc();
+	uint8_t checksum_actual = serial_getc();
 	return (checksum == checksum_actual) ? XMODEM_OK : XMODEM_ERROR;
 }
 
-static void xmodem_write_block(const uint8_t __far* block) {
-	ws_serial_putc(SOH);
-	ws_serial_putc(xmodem_idx);
-	ws_serial_putc(xmodem_idx ^ 0xFF);
+static void xmodem_write_block(const uint8_t __far* block, uint16_t length) {
+	serial_putc(length == XMODEM_BLOCK_SIZE_1K ? STX : SOH);
+	serial_putc(xmodem_idx);
+	serial_putc(xmodem_idx ^ 0xFF);
 
 	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
+	for (uint16_t i = 0; i < length; i++) {
 		uint8_t v = block[i];
-		ws_serial_putc(v);
+		serial_putc(v);
 		checksum += v;
 	}
 
-	ws_serial_putc(checksum);
+	serial_putc(checksum);
 }
 
 uint8_t xmodem_recv_start(void) {
 	xmodem_idx = 1;
-	ws_serial_putc(NAK);
+	serial_putc(NAK);
 
 	return XMODEM_OK;
 }
 
-uint8_t xmodem_recv_block(uint8_t __far* block) {
+static uint8_t xmodem_recv_block_inner(uint8_t __far* block, uint16_t *length) {
 	uint8_t retries = 10;
+	uint16_t capacity = *length;
 
 	while (1) {
 		if ((retries--) == 0) return XMODEM_ERROR;
 		if (xmodem_poll_exit()) return XMODEM_SELF_CANCEL;
 
-		int16_t r = ws_serial_getc();
+		int16_t r = serial_getc();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
-			} else if (r == SOH) {
-				uint8_t result = xmodem_read_block(block);
+			} else if (r == SOH || r == STX) {
+				uint16_t block_length = (r == STX) ? XMODEM_BLOCK_SIZE_1K : XMODEM_BLOCK_SIZE;
+				// a block which does not fit is drained, then cancelled
+				uint8_t result = xmodem_read_block(block_length <= capacity ? block : NULL, block_length);
+				if (block_length > capacity) {
+					result = XMODEM_CANCEL;
+				}
 				if (result == XMODEM_OK) {
+					*length = block_length;
 					return XMODEM_OK;
 				} else if (result == XMODEM_ERROR) {
-					ws_serial_putc(NAK);
+					trace_event(TRACE_XMODEM_RETRY);
+					serial_putc(NAK);
 				} else {
-					ws_serial_putc(CAN);
+					serial_putc(CAN);
 					return XMODEM_ERROR;
 				}
 			} else if (r == EOT) {
-				ws_serial_putc(ACK);
+				serial_putc(ACK);
 				return XMODEM_COMPLETE;
 			} else {
 				// TODO: Is this right?
-				ws_serial_putc(NAK);
+				serial_putc(NAK);
 			}
 		}
-
-		/* ws_hwint_enable(HWINT_SERIAL_RX);
-		cpu_halt(); */
 	}
 }
 
+uint8_t xmodem_recv_block(uint8_t __far* block, uint16_t *length) {
+	trace_begin(TRACE_XMODEM_RECV);
+	uint8_t result = xmodem_recv_block_inner(block, length);
+	trace_end(TRACE_XMODEM_RECV);
+	return result;
+}
+
 void xmodem_recv_ack(void) {
 	xmodem_idx++;
-	ws_serial_putc(ACK);
+	serial_putc(ACK);
+}
+
+void xmodem_recv_cancel(void) {
+	serial_putc(CAN);
+	serial_putc(CAN);
 }
 
 uint8_t xmodem_send_start(void) {
 	xmodem_idx = 1;
-
-#ifndef __WONDERFUL_WWITCH__
-	cpu_irq_disable();
-        ws_hwint_enable(HWINT_SERIAL_RX);
-#endif
+	xmodem_1k_disabled = false;
 
 	while (!xmodem_poll_exit()) {
-#ifdef __WONDERFUL_WWITCH__
-		int16_t r = comm_receive_char();
-#else
-		int16_t r = ws_serial_getc_nonblock();
-#endif
-		if (r >= 0) {
-#ifndef __WONDERFUL_WWITCH__
-		        ws_hwint_disable(HWINT_SERIAL_RX);
-#endif
-			if (r == CAN) {
-				return XMODEM_CANCEL;
-			} else if (r == NAK) {
-				return XMODEM_OK;
-			}
+		int16_t r = serial_getc_nonblock();
+		if (r == CAN) {
+			return XMODEM_CANCEL;
+		} else if (r == NAK) {
+			return XMODEM_OK;
 		}
 #ifndef __WONDERFUL_WWITCH__
-		__asm volatile ("sti\nhlt\ncli");
+		if (r < 0) cpu_halt();
 #endif
 	}
 	return XMODEM_SELF_CANCEL;
 }
 
-uint8_t xmodem_send_block(const uint8_t __far* block) {
-	uint8_t retries = 10;
-WriteAgain:
-	if ((retries--) == 0) return XMODEM_ERROR;
-	xmodem_write_block(block);
+void xmodem_send_block_start(const uint8_t __far* block, uint16_t length) {
+	xmodem_send_ptr = block;
+	xmodem_send_length = length;
+	xmodem_send_retries = ((length == XMODEM_BLOCK_SIZE_1K) ? XMODEM_1K_RETRIES : 10) - 1;
+	trace_begin(TRACE_XMODEM_SEND);
+	xmodem_write_block(block, length);
+}
 
+static uint8_t xmodem_send_block_wait(void) {
 	while (!xmodem_poll_exit()) {
-		int16_t r = ws_serial_getc();
+		int16_t r = serial_getc();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
 			} else if (r == NAK) {
-				goto WriteAgain;
+				if (xmodem_send_retries == 0) return XMODEM_ERROR;
+				xmodem_send_retries--;
+				trace_event(TRACE_XMODEM_RETRY);
+				xmodem_write_block(xmodem_send_ptr, xmodem_send_length);
 			} else if (r == ACK) {
 				xmodem_idx++;
 				return XMODEM_OK;
@@ -210,14 +216,39 @@ WriteAgain:
 	return XMODEM_SELF_CANCEL;
 }
 
+uint8_t xmodem_send_block_finish(void) {
+	uint8_t result = xmodem_send_block_wait();
+	trace_end(TRACE_XMODEM_SEND);
+	return result;
+}
+
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t length) {
+	if (length == XMODEM_BLOCK_SIZE_1K && xmodem_1k_disabled) {
+		for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE_1K; i += XMODEM_BLOCK_SIZE) {
+			uint8_t result = xmodem_send_block(block + i, XMODEM_BLOCK_SIZE);
+			if (result != XMODEM_OK) return result;
+		}
+		return XMODEM_OK;
+	}
+
+	xmodem_send_block_start(block, length);
+	uint8_t result = xmodem_send_block_finish();
+	if (result == XMODEM_ERROR && length == XMODEM_BLOCK_SIZE_1K) {
+		// the receiver may not support XMODEM-1K
+		xmodem_1k_disabled = true;
+		return xmodem_send_block(block, length);
+	}
+	return result;
+}
+
 uint8_t xmodem_send_finish(void) {
 	uint8_t retries = 10;
 WriteAgain:
 	if ((retries--) == 0) return XMODEM_ERROR;
-	ws_serial_putc(EOT);
+	serial_putc(EOT);
 
 	while (!xmodem_poll_exit()) {
-		int16_t r = ws_serial_getc();
+		int16_t r = serial_getc();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #define XMODEM_BLOCK_SIZE 128
+#define XMODEM_BLOCK_SIZE_1K 1024
 
 #define XMODEM_OK          0 /* OK */
 #define XMODEM_CANCEL      1 /* user cancellation */
@@ -40,9 +41,27 @@ void xmodem_open(uint8_t baudrate);
 void xmodem_close(void);
 
 uint8_t xmodem_send_start(void);
-uint8_t xmodem_send_block(const uint8_t __far* block);
+/**
+ * Send a block of XMODEM_BLOCK_SIZE or XMODEM_BLOCK_SIZE_1K bytes.
+ * If the receiver keeps rejecting 1K blocks, the rest of the session
+ * falls back to 128-byte blocks.
+ */
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t length);
+/**
+ * Send a block in two steps, so that the caller can do other work (such as
+ * preparing the next block) while the receiver checks it. The block must
+ * stay unchanged until xmodem_send_block_finish() returns, as it may have
+ * to be sent again. There is no fallback from 1K to 128-byte blocks.
+ */
+void xmodem_send_block_start(const uint8_t __far* block, uint16_t length);
+uint8_t xmodem_send_block_finish(void);
 uint8_t xmodem_send_finish(void);
 
 uint8_t xmodem_recv_start(void);
-uint8_t xmodem_recv_block(uint8_t __far* block);
-void xmodem_recv_ack(void);
\ No newline at end of file
+/**
+ * Receive a block. On entry, length holds the buffer capacity; on success,
+ * it holds the received block size (XMODEM_BLOCK_SIZE or XMODEM_BLOCK_SIZE_1K).
+ */
+uint8_t xmodem_recv_block(uint8_t __far* block, uint16_t *length);
+void xmodem_recv_ack(void);
+void xmodem_recv_cancel(void);
\ No newline at end of file
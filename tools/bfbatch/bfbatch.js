@@ -0,0 +1,202 @@
+#!/usr/bin/env node
+// BootFriend for WS - batch installer generator
+// Copyright (c) 2023 Adrian "asie" Siekierka
+//
+// Generates installers for many splash images and settings at once, with
+// the web configuration utility's own code (web/bfimg.js, web/bfgen.js and
+// the installer binaries in web/resources.js), spread over all CPU cores.
+//
+// The manifest is a JSON file:
+//
+//   {
+//     "defaults": { ...settings... },
+//     "jobs": [ { "output": "out/alice", "image": "alice.png", ...settings... }, ... ]
+//   }
+//
+// Paths are relative to the manifest. Each job writes its outputs into its
+// "output" directory, under the names the web page downloads them as. A
+// job's settings override the defaults; those not given anywhere take the
+// web page's initial values:
+//
+//   image                   PNG image; no image shows only the console name
+//   outputs                 any of "rom", "wwfx", "wwsoft", "raw"; all by default
+//   color                   name color, 0 (black) - 12
+//   duration                1.70 - 3.25 seconds
+//   background              background color, "#rrggbb"
+//   alignment               0 - 8: top left, top center, ... bottom right
+//   offset                  {"h": [x, y], "v": [x, y]}, image offsets in tiles
+//   name                    {"h": [x, y], "v": [x, y]}, name centers, null to hide
+//   inverseColorCorrection  true or false
+//   eeprom                  custom IEEPROM data to install instead of a splash
+//   date                    installer build date, "YYYY-MM-DDTHH:MM"; now by default
+//   developer               true to install the developer build of BootFriend
+
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const vm = require("vm");
+const { Worker, isMainThread, parentPort, workerData } = require("worker_threads");
+const { png_decode } = require("./png.js");
+
+const WEB_DIR = path.join(__dirname, "..", "..", "web");
+
+const DEFAULTS = {
+    "image": null,
+    "outputs": ["rom", "wwfx", "wwsoft", "raw"],
+    "color": 0,
+    "duration": 1.70,
+    "background": "#ffffff",
+    "alignment": 4,
+    "offset": {"h": [0, -1], "v": [0, -1]},
+    "name": {"h": [112, 112], "v": [72, 152]},
+    "inverseColorCorrection": false,
+    "eeprom": null,
+    "date": null,
+    "developer": false
+};
+
+// Runs the web page's scripts in this thread's global scope, as the page
+// and its encoder worker do.
+function load_web_scripts(resources) {
+    for (var fn of [path.join(WEB_DIR, "bfimg.js"), path.join(WEB_DIR, "bfgen.js"), resources]) {
+        vm.runInThisContext(fs.readFileSync(fn, "utf8"), { filename: fn });
+    }
+}
+
+function usage() {
+    console.error("Usage: bfbatch.js [-j JOBS] [-r resources.js] manifest.json\n"
+        + "  -j JOBS   run JOBS jobs at once (default: number of CPUs)\n"
+        + "  -r FILE   web resources, as written by gen_web_data.sh (default: web/resources.js)");
+    process.exit(1);
+}
+
+function read_manifest(fn) {
+    var manifest = JSON.parse(fs.readFileSync(fn, "utf8"));
+    var dir = path.dirname(fn);
+    var defaults = Object.assign({}, DEFAULTS, manifest.defaults || {});
+    var now = Date.now();
+
+    if (!Array.isArray(manifest.jobs)) throw new Error(fn + ": no \"jobs\" list");
+    return manifest.jobs.map(function(entry, i) {
+        var job = Object.assign({}, defaults, entry);
+        job.offset = Object.assign({}, DEFAULTS.offset, defaults.offset, entry.offset);
+        job.name = Object.assign({}, DEFAULTS.name, defaults.name, entry.name);
+        if (typeof job.output != "string") throw new Error(fn + ": job " + i + " has no \"output\"");
+        for (var type of job.outputs) {
+            if (!(type in bf_image_types)) throw new Error(fn + ": job " + i + ": unknown output \"" + type + "\"");
+        }
+        job.output = path.resolve(dir, job.output);
+        if (job.image != null) job.image = path.resolve(dir, job.image);
+        if (job.eeprom != null) job.eeprom = path.resolve(dir, job.eeprom);
+        job.date = job.date != null ? new Date(job.date).getTime() : now;
+        if (isNaN(job.date)) throw new Error(fn + ": job " + i + ": invalid date");
+        return job;
+    });
+}
+
+// Mirrors the page's custom EEPROM file input.
+function read_eeprom(fn) {
+    var eeprom = new Uint8Array(fs.readFileSync(fn));
+    if (eeprom.length == 2048) return eeprom.subarray(128, 2048);
+    if (eeprom.length <= 1920) return eeprom;
+    throw new Error("Invalid EEPROM size!");
+}
+
+function run_job(job) {
+    var tm = null;
+    if (job.image != null) {
+        bfimg_inverse_color_correct = job.inverseColorCorrection;
+        tm = bfimg_to_tilemap(png_decode(fs.readFileSync(job.image)));
+    }
+
+    var settings = {
+        "color": job.color,
+        "duration": job.duration,
+        "nameLocations": bf_name_locations([job.name.h, job.name.v]),
+        "imageLocations": bf_image_locations(tm, job.alignment, [job.offset.h, job.offset.v]),
+        "backgroundColor": bf_parse_color(job.background),
+        "eepromType": job.eeprom != null ? 1 : 0,
+        "customEeprom": job.eeprom != null ? read_eeprom(job.eeprom) : null,
+        "date": new Date(job.date),
+        "developer": job.developer
+    };
+
+    var files = [];
+    fs.mkdirSync(job.output, { recursive: true });
+    for (var type of job.outputs) {
+        var fn = path.join(job.output, bf_image_types[type]);
+        fs.writeFileSync(fn, bf_generate_image(type, tm, settings));
+        files.push(fn);
+    }
+    return files;
+}
+
+function main(argv) {
+    var jobCount = typeof os.availableParallelism == "function" ? os.availableParallelism() : os.cpus().length;
+    var resources = path.join(WEB_DIR, "resources.js");
+    var manifestFn = null;
+    for (var i = 0; i < argv.length; i++) {
+        if (argv[i] == "-j" && i + 1 < argv.length) jobCount = parseInt(argv[++i]);
+        else if (argv[i] == "-r" && i + 1 < argv.length) resources = path.resolve(argv[++i]);
+        else if (manifestFn == null && !argv[i].startsWith("-")) manifestFn = argv[i];
+        else usage();
+    }
+    if (manifestFn == null || !(jobCount > 0)) usage();
+    if (!fs.existsSync(resources)) {
+        console.error(resources + ": not found; build the installers and run gen_web_data.sh first");
+        process.exit(1);
+    }
+
+    load_web_scripts(resources);
+    var jobs;
+    try {
+        jobs = read_manifest(manifestFn);
+    } catch (err) {
+        console.error(err.message);
+        process.exit(1);
+    }
+
+    var next = 0, done = 0, failed = 0;
+    var start = performance.now();
+    function finish() {
+        var ms = performance.now() - start;
+        console.log(done + " jobs, " + failed + " failed, in " + (ms / 1000).toFixed(2) + " s");
+        process.exit(failed > 0 ? 1 : 0);
+    }
+    if (jobs.length == 0) finish();
+
+    for (var w = 0; w < Math.min(jobCount, jobs.length); w++) {
+        var worker = new Worker(__filename, { workerData: { "resources": resources } });
+        worker.on("message", function(msg) {
+            var job = jobs[msg.index];
+            done++;
+            if (msg.error != null) {
+                failed++;
+                console.error(path.relative(".", job.output) + ": " + msg.error);
+            } else {
+                console.log(msg.files.map(fn => path.relative(".", fn)).join(" "));
+            }
+            if (next < jobs.length) this.postMessage({ "index": next, "job": jobs[next++] });
+            else this.terminate();
+            if (done == jobs.length) finish();
+        });
+        worker.on("error", function(err) {
+            console.error(err);
+            process.exit(1);
+        });
+        worker.postMessage({ "index": next, "job": jobs[next++] });
+    }
+}
+
+if (isMainThread) {
+    main(process.argv.slice(2));
+} else {
+    load_web_scripts(workerData.resources);
+    parentPort.on("message", function(msg) {
+        try {
+            parentPort.postMessage({ "index": msg.index, "files": run_job(msg.job) });
+        } catch (err) {
+            parentPort.postMessage({ "index": msg.index, "error": err.message });
+        }
+    });
+}
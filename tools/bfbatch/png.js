@@ -0,0 +1,151 @@
+// BootFriend for WS - batch installer generator, PNG decoder
+// Copyright (c) 2023 Adrian "asie" Siekierka
+//
+// Decodes a PNG file to 8-bit RGBA, as the web page sees it through a
+// canvas: 16-bit samples are truncated, color profiles and gamma are
+// ignored and fully transparent pixels read back as black. Partially
+// transparent pixels are passed through as they are; a browser's
+// premultiplied canvas may round them differently.
+
+const zlib = require("zlib");
+
+const PNG_SIGNATURE = Buffer.from([0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A]);
+const CHANNELS = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4};
+
+// Adam7 passes: x start, y start, x step, y step
+const ADAM7 = [[0, 0, 8, 8], [4, 0, 8, 8], [0, 4, 4, 8], [2, 0, 4, 4], [0, 2, 2, 4], [1, 0, 2, 2], [0, 1, 1, 2]];
+
+function paeth(a, b, c) {
+    var p = a + b - c;
+    var pa = Math.abs(p - a), pb = Math.abs(p - b), pc = Math.abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Undoes the row filters of one (sub)image in place; returns the offset
+// past its last row.
+function unfilter(data, offset, rowBytes, height, bpp) {
+    var prev = null;
+    for (var y = 0; y < height; y++) {
+        var filter = data[offset];
+        var row = offset + 1;
+        for (var i = 0; i < rowBytes; i++) {
+            var a = i >= bpp ? data[row + i - bpp] : 0;
+            var b = prev != null ? data[prev + i] : 0;
+            var c = (prev != null && i >= bpp) ? data[prev + i - bpp] : 0;
+            var x = data[row + i];
+            switch (filter) {
+            case 0: break;
+            case 1: x += a; break;
+            case 2: x += b; break;
+            case 3: x += (a + b) >> 1; break;
+            case 4: x += paeth(a, b, c); break;
+            default: throw new Error("invalid PNG filter type " + filter);
+            }
+            data[row + i] = x;
+        }
+        prev = row;
+        offset = row + rowBytes;
+    }
+    return offset;
+}
+
+function png_decode(buf) {
+    if (buf.length < 8 || !buf.subarray(0, 8).equals(PNG_SIGNATURE)) {
+        throw new Error("not a PNG file");
+    }
+
+    var width, height, depth, type, interlace;
+    var palette = null, trns = null;
+    var idat = [];
+    for (var pos = 8; pos + 8 <= buf.length; ) {
+        var len = buf.readUInt32BE(pos);
+        var name = buf.toString("latin1", pos + 4, pos + 8);
+        var chunk = buf.subarray(pos + 8, pos + 8 + len);
+        pos += 12 + len;
+        if (name == "IHDR") {
+            width = chunk.readUInt32BE(0);
+            height = chunk.readUInt32BE(4);
+            depth = chunk[8];
+            type = chunk[9];
+            interlace = chunk[12];
+            if (!(type in CHANNELS)) throw new Error("invalid PNG color type " + type);
+        } else if (name == "PLTE") {
+            palette = chunk;
+        } else if (name == "tRNS") {
+            trns = chunk;
+        } else if (name == "IDAT") {
+            idat.push(chunk);
+        } else if (name == "IEND") {
+            break;
+        }
+    }
+    if (width == null || idat.length == 0) throw new Error("truncated PNG file");
+    if (type == 3 && palette == null) throw new Error("PNG file has no palette");
+
+    var data = zlib.inflateSync(Buffer.concat(idat));
+    var channels = CHANNELS[type];
+    var bitsPerPixel = channels * depth;
+    var bpp = Math.max(1, bitsPerPixel >> 3);
+    var rgba = new Uint8ClampedArray(width * height * 4);
+    var maxSample = (1 << depth) - 1;
+
+    // transparent sample values, for gray and RGB images
+    var trnsKey = null;
+    if (trns != null && type == 0) trnsKey = [trns.readUInt16BE(0)];
+    if (trns != null && type == 2) trnsKey = [trns.readUInt16BE(0), trns.readUInt16BE(2), trns.readUInt16BE(4)];
+
+    function sample(row, x, c) {
+        if (depth == 8) return data[row + x * channels + c];
+        if (depth == 16) return data.readUInt16BE(row + (x * channels + c) * 2);
+        var bit = x * depth;
+        return (data[row + (bit >> 3)] >> (8 - depth - (bit & 7))) & maxSample;
+    }
+
+    function to8(v) {
+        return depth == 16 ? v >> 8 : Math.round(v * 255 / maxSample);
+    }
+
+    function decodePass(offset, xs, ys, dx, dy) {
+        var pw = Math.ceil((width - xs) / dx);
+        var ph = Math.ceil((height - ys) / dy);
+        if (pw <= 0 || ph <= 0) return offset;
+        var rowBytes = Math.ceil(pw * bitsPerPixel / 8);
+        var end = unfilter(data, offset, rowBytes, ph, bpp);
+        for (var y = 0; y < ph; y++) {
+            var row = offset + y * (rowBytes + 1) + 1;
+            for (var x = 0; x < pw; x++) {
+                var o = (((ys + y * dy) * width) + xs + x * dx) * 4;
+                var r, g, b, a = 255;
+                if (type == 3) {
+                    var idx = sample(row, x, 0);
+                    r = palette[idx * 3]; g = palette[idx * 3 + 1]; b = palette[idx * 3 + 2];
+                    if (trns != null && idx < trns.length) a = trns[idx];
+                } else if (type == 0 || type == 4) {
+                    var v = sample(row, x, 0);
+                    r = g = b = to8(v);
+                    if (type == 4) a = to8(sample(row, x, 1));
+                    else if (trnsKey != null && v == trnsKey[0]) a = 0;
+                } else {
+                    var rv = sample(row, x, 0), gv = sample(row, x, 1), bv = sample(row, x, 2);
+                    r = to8(rv); g = to8(gv); b = to8(bv);
+                    if (type == 6) a = to8(sample(row, x, 3));
+                    else if (trnsKey != null && rv == trnsKey[0] && gv == trnsKey[1] && bv == trnsKey[2]) a = 0;
+                }
+                if (a == 0) { r = g = b = 0; }
+                rgba[o] = r; rgba[o + 1] = g; rgba[o + 2] = b; rgba[o + 3] = a;
+            }
+        }
+        return end;
+    }
+
+    if (interlace == 1) {
+        var offset = 0;
+        for (var p of ADAM7) offset = decodePass(offset, p[0], p[1], p[2], p[3]);
+    } else {
+        decodePass(0, 0, 0, 1, 1);
+    }
+    return {"width": width, "height": height, "data": rgba};
+}
+
+module.exports = { png_decode };
@@ -0,0 +1,133 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Converts a 'bF' .bfb file to a compressed 'bZ' .bfb file.
+
+from collections import deque
+import argparse
+import struct
+import sys
+
+LOAD_START = 0x6800
+LOAD_END = 0xFE00
+
+MAX_LITERALS = 0x7F
+MIN_MATCH = 3
+MAX_MATCH = 0x7F + MIN_MATCH
+MAX_CHAIN = 256
+
+def find_matches(data):
+    """For every position, return (length, distance) of the longest match."""
+    matches = [None] * len(data)
+    heads = {}
+    chain = [-1] * len(data)
+    for i in range(len(data) - MIN_MATCH + 1):
+        key = bytes(data[i:i+MIN_MATCH])
+        j = heads.get(key, -1)
+        best_len, best_dist = 0, 0
+        max_len = min(MAX_MATCH, len(data) - i)
+        depth = MAX_CHAIN
+        while j >= 0 and depth > 0:
+            l = MIN_MATCH
+            while l < max_len and data[j+l] == data[i+l]:
+                l += 1
+            if l > best_len:
+                best_len, best_dist = l, i - j
+                if l == max_len:
+                    break
+            j = chain[j]
+            depth -= 1
+        if best_len >= MIN_MATCH:
+            matches[i] = (best_len, best_dist)
+        chain[i] = heads.get(key, -1)
+        heads[key] = i
+    return matches
+
+def compress(data):
+    """Optimal parse: a literal run costs its length + 1, a match costs 3 bytes."""
+    n = len(data)
+    matches = find_matches(data)
+    cost = [0] * (n + 1)
+    step = [None] * (n + 1)
+    # sliding minimum of cost[j] + j over the next MAX_LITERALS positions
+    window = deque([n])
+    for i in range(n - 1, -1, -1):
+        while window[0] > i + MAX_LITERALS:
+            window.popleft()
+        j = window[0]
+        cost[i] = cost[j] + (j - i) + 1
+        step[i] = ('L', j - i)
+        if matches[i] is not None:
+            length, dist = matches[i]
+            for l in range(MIN_MATCH, length + 1):
+                if cost[i+l] + 3 < cost[i]:
+                    cost[i] = cost[i+l] + 3
+                    step[i] = ('M', l, dist)
+        while window and cost[window[-1]] + window[-1] >= cost[i] + i:
+            window.pop()
+        window.append(i)
+
+    out = bytearray()
+    # minimum distance between the packed data and the unpacked data, so that
+    # unpacking never overwrites packed bytes which were not yet read
+    margin = 0
+    i = 0
+    while i < n:
+        s = step[i]
+        if s[0] == 'L':
+            out.append(s[1])
+            margin = max(margin, i - len(out))
+            out += data[i:i+s[1]]
+            i += s[1]
+        else:
+            out.append(0x80 | (s[1] - MIN_MATCH))
+            out += struct.pack("<H", s[2])
+            margin = max(margin, i + s[1] - len(out))
+            i += s[1]
+    out.append(0)
+    return out, margin
+
+def main(args):
+    with open(args.input, "rb") as f:
+        data = f.read()
+    if data[0:2] != b"bF":
+        raise Exception("%s: not a 'bF' .bfb file" % args.input)
+    address = struct.unpack("<H", data[2:4])[0]
+    dest = LOAD_START if address == 0xFFFF else address
+    payload = data[4:]
+    if dest < LOAD_START or dest + len(payload) > LOAD_END:
+        raise Exception("%s: program does not fit in %04X-%04X" % (args.input, LOAD_START, LOAD_END - 1))
+
+    packed, margin = compress(payload)
+    # place the packed data as high as possible
+    packed_addr = LOAD_END - len(packed)
+    # the loader moves the first block's data there from past its 'bZ'
+    # header, which ends at 6802
+    if packed_addr < max(dest + margin, LOAD_START + 2):
+        raise Exception("%s: not enough room to unpack in place" % args.input)
+
+    with open(args.output, "wb") as f:
+        f.write(b"bZ")
+        f.write(struct.pack("<HH", address, packed_addr))
+        f.write(packed)
+
+    print("%s: %d -> %d bytes (%.2fx), packed data at %04X" % (args.input,
+        len(payload), len(packed), len(payload) / max(len(packed), 1), packed_addr))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compress a .bfb file.")
+    parser.add_argument("input", help="Input 'bF' .bfb file")
+    parser.add_argument("output", help="Output 'bZ' .bfb file")
+    main(parser.parse_args())
@@ -0,0 +1,78 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Builds a multi-segment 'bS' .bfb file from raw binaries.
+
+import argparse
+import struct
+import sys
+
+LOAD_START = 0x6800
+LOAD_END = 0xFE00
+
+HEADER_SIZE = 1024
+MAX_SEGMENTS = 20
+BLOCK_SIZE = 1024
+IRAM = 0xFF
+
+def parse_segment(spec):
+    """Parse ADDR:FILE (IRAM) or BANK:ADDR:FILE (cartridge SRAM)."""
+    parts = spec.split(":", 2)
+    if len(parts) == 2:
+        bank, address, fn = IRAM, int(parts[0], 0), parts[1]
+    elif len(parts) == 3:
+        bank, address, fn = int(parts[0], 0), int(parts[1], 0), parts[2]
+        if bank >= IRAM:
+            raise Exception("%s: invalid SRAM bank" % spec)
+    else:
+        raise Exception("%s: expected ADDR:FILE or BANK:ADDR:FILE" % spec)
+    with open(fn, "rb") as f:
+        data = f.read()
+    return bank, address, data
+
+def main(args):
+    segment, offset = args.entry.split(":") if ":" in args.entry else ("0", args.entry)
+    entry = (int(offset, 0), int(segment, 0))
+    segments = [parse_segment(s) for s in args.segments]
+    if len(segments) > MAX_SEGMENTS:
+        raise Exception("at most %d segments are supported" % MAX_SEGMENTS)
+
+    header = bytearray(b"bS")
+    header += struct.pack("<HHBB", entry[0], entry[1], len(segments), 0)
+    body = bytearray()
+    for i, (bank, address, data) in enumerate(segments):
+        # every segment but the last fills whole blocks, so that no block
+        # spans two segments
+        if i < len(segments) - 1:
+            data = data.ljust((len(data) + BLOCK_SIZE - 1) // BLOCK_SIZE * BLOCK_SIZE, b"\x00")
+        # the loader computes the end address in 16 bits, so a segment must
+        # end at 0xFFFE
+        if len(data) == 0 or address + len(data) > 0xFFFF:
+            raise Exception("segment %d: %d bytes do not fit at %04X (must end by FFFE)" % (i, len(data), address))
+        if bank == IRAM and (address < LOAD_START or address + len(data) > LOAD_END):
+            raise Exception("segment %d: does not fit in %04X-%04X" % (i, LOAD_START, LOAD_END - 1))
+        header += struct.pack("<HHBB", address, len(data), bank, 0)
+        body += data
+
+    with open(args.output, "wb") as f:
+        f.write(header.ljust(HEADER_SIZE, b"\x00"))
+        f.write(body)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Build a multi-segment .bfb file.")
+    parser.add_argument("-e", "--entry", required=True, help="Entry point, [SEGMENT:]OFFSET")
+    parser.add_argument("output", help="Output 'bS' .bfb file")
+    parser.add_argument("segments", nargs="+", help="Segments, in load order: ADDR:FILE for IRAM, BANK:ADDR:FILE for cartridge SRAM (0x1000:ADDR)")
+    main(parser.parse_args())
@@ -0,0 +1,144 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Sends a .bfb file to BootFriend over XMODEM, resuming an interrupted
+# transfer where it left off. Requires pyserial.
+
+import argparse
+import struct
+import sys
+import time
+import serial
+
+SOH = 1
+STX = 2
+EOT = 4
+ENQ = 5
+ACK = 6
+NAK = 21
+SYN = 22
+CAN = 24
+
+LOAD_START = 0x6800
+FIRST_BLOCK = LOAD_START - 4
+SEGMENTED_HEADER_SIZE = 1024
+RETRIES = 10
+
+def data_address(data):
+    """Return the (load address, header size) of the data sent after the header;
+    None for 'bS' files, whose data is spread over several segments."""
+    if data[0:2] == b"bS":
+        return None, 0
+    elif data[0:2] == b"bZ":
+        return struct.unpack("<H", data[4:6])[0], 6
+    elif data[0:2] == b"bF":
+        address = struct.unpack("<H", data[2:4])[0]
+        return LOAD_START if address == 0xFFFF else address, 4
+    raise Exception("not a .bfb file")
+
+def segmented_offset(data, pointer, left):
+    """Return the file offset of a 'bS' transfer from the load pointer and
+    the number of segments not yet started."""
+    count = data[6]
+    if left >= count:
+        return pointer - FIRST_BLOCK
+    offset = SEGMENTED_HEADER_SIZE
+    for i in range(count - left):
+        address, length = struct.unpack("<HH", data[8+i*6:12+i*6])
+        if i == count - 1 - left:
+            return offset + pointer - address
+        offset += length
+
+def query_resume(port, timeout, segmented):
+    """Ask a running loader where to resume; None if there is nothing to resume."""
+    # let the loader give up on any block it was in the middle of
+    time.sleep(0.5)
+    port.reset_input_buffer()
+    port.write(bytes([ENQ]))
+    # only a DEV loader, which can load 'bS' files, reports segments left
+    size = 4 if segmented else 3
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        c = port.read(1)
+        if c == bytes([SYN]):
+            reply = port.read(size)
+            if len(reply) == size:
+                return reply[0], struct.unpack("<H", reply[1:3])[0], reply[3] if segmented else 0
+    return None
+
+def send_packet(port, packet, timeout):
+    """Send a packet until it is acknowledged; False on cancel or too many retries."""
+    for i in range(RETRIES):
+        port.reset_input_buffer()
+        port.write(packet)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            c = port.read(1)
+            if c == bytes([ACK]):
+                return True
+            elif c == bytes([NAK]):
+                break
+            elif c == bytes([CAN]):
+                return False
+    return False
+
+def main(args):
+    with open(args.input, "rb") as f:
+        data = f.read()
+    address, header_size = data_address(data)
+
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    block_id, offset = 1, 0
+    resume = None if args.restart else query_resume(port, 1.0, address is None)
+    # Block IDs wrap after 256 blocks, so only the load pointer tells a fresh
+    # loader apart: it is at the first block, with no 'bS' segment table read.
+    if resume is not None and not (resume[1] == FIRST_BLOCK and (address is not None or resume[2] == 0)):
+        block_id = resume[0]
+        if address is None:
+            offset = segmented_offset(data, resume[1], resume[2])
+        else:
+            offset = resume[1] - address + header_size
+        if offset < header_size or offset > len(data):
+            raise Exception("console is loading a different file (load pointer %04X)" % resume[1])
+        print("resuming at block %d, offset %d" % (block_id, offset))
+
+    while offset < len(data):
+        size = 1024 if args.kilo and len(data) - offset > 896 else 128
+        block = data[offset:offset+size].ljust(size, b"\x1A")
+        packet = bytes([STX if size == 1024 else SOH, block_id, block_id ^ 0xFF])
+        packet += block + bytes([sum(block) & 0xFF])
+        if not send_packet(port, packet, args.timeout):
+            port.write(bytes([CAN, CAN]))
+            print("\ntransfer failed at offset %d; run again to resume" % offset)
+            return 1
+        offset += size
+        block_id = (block_id + 1) & 0xFF
+        print("\r%d/%d bytes" % (min(offset, len(data)), len(data)), end="", flush=True)
+    print()
+
+    if not send_packet(port, bytes([EOT]), args.timeout):
+        print("end of transfer not acknowledged")
+        return 1
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Send a .bfb file to BootFriend, resuming interrupted transfers.")
+    parser.add_argument("-b", "--baud", type=int, default=38400, help="Baud rate (38400, or 9600 when holding Y2)")
+    parser.add_argument("-k", "--kilo", action="store_true", help="Use 1024-byte (XMODEM-1K) blocks")
+    parser.add_argument("-r", "--restart", action="store_true", help="Always start from the beginning")
+    parser.add_argument("-t", "--timeout", type=float, default=2.0, help="Seconds to wait for a block to be acknowledged")
+    parser.add_argument("port", help="Serial port")
+    parser.add_argument("input", help="Input .bfb file")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,339 @@
+/**
+ * BootFriend - static worst-case cycle analyzer
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Walks every path through a piece of bootfriend.bin, from an entry label
+// to a stop label, a return from the entry's own level, a far jump or a
+// HLT, and reports the most expensive one.
+//
+// Labels come from a NASM listing (nasm -l). So do annotations, written as
+// comments on the instruction they apply to:
+//
+//   ; wcet: N          a branch is taken at most N times per path, or
+//                      a REP string instruction runs N times
+//   ; wcet: taken      a conditional branch is assumed to be always taken
+//   ; wcet: not taken  ... or never taken
+//   ; wcet: stop       the path ends here
+//
+// A loop without an annotation is an error.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "v30mz.h"
+
+#define MAX_LABELS 1024
+#define MAX_STOPS 8
+#define MAX_DEPTH 32
+
+#define ANNOT_NONE      0
+#define ANNOT_COUNT     1
+#define ANNOT_TAKEN     2
+#define ANNOT_NOT_TAKEN 3
+#define ANNOT_STOP      4
+
+typedef struct {
+    char name[64];
+    uint16_t addr;
+} label_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t count;
+} annot_t;
+
+static uint8_t code[0x10000];
+static uint32_t code_size;
+static label_t labels[MAX_LABELS];
+static int label_count;
+static annot_t annots[0x10000];
+
+// per-path state
+static uint16_t stops[MAX_STOPS];
+static int stop_count;
+static uint8_t on_path[0x10000];
+static uint16_t taken_count[0x10000];
+static uint16_t call_stack[MAX_DEPTH];
+static bool failed;
+
+static const char *label_at(uint16_t addr) {
+    static char buf[80];
+    const label_t *best = NULL;
+    for (int i = 0; i < label_count; i++) {
+        if (labels[i].addr <= addr && (best == NULL || labels[i].addr > best->addr)) best = &labels[i];
+    }
+    if (best == NULL) snprintf(buf, sizeof(buf), "%04X", addr);
+    else if (best->addr == addr) snprintf(buf, sizeof(buf), "%04X (%s)", addr, best->name);
+    else snprintf(buf, sizeof(buf), "%04X (%s+%d)", addr, best->name, addr - best->addr);
+    return buf;
+}
+
+static bool parse_address(const char *s, uint16_t *addr) {
+    for (int i = 0; i < label_count; i++) {
+        if (!strcmp(labels[i].name, s)) {
+            *addr = labels[i].addr;
+            return true;
+        }
+    }
+    char *end;
+    unsigned long v = strtoul(s, &end, 16);
+    if (*s == 0 || *end != 0 || v > 0xFFFF) return false;
+    *addr = v;
+    return true;
+}
+
+static void parse_annotation(const char *comment, uint16_t addr) {
+    const char *s = strstr(comment, "wcet:");
+    if (s == NULL) return;
+    s += 5;
+    while (isspace((unsigned char) *s)) s++;
+    annot_t *a = &annots[addr];
+    if (!strncmp(s, "not taken", 9)) a->type = ANNOT_NOT_TAKEN;
+    else if (!strncmp(s, "taken", 5)) a->type = ANNOT_TAKEN;
+    else if (!strncmp(s, "stop", 4)) a->type = ANNOT_STOP;
+    else if (isdigit((unsigned char) *s)) {
+        a->type = ANNOT_COUNT;
+        a->count = strtoul(s, NULL, 0);
+    } else {
+        fprintf(stderr, "%04X: unknown annotation: %s", addr, comment);
+        exit(1);
+    }
+}
+
+// Listing lines look like: "   216 000000A1 50                      <1> push ax".
+// Lines without code have no address; a label on one belongs to the next
+// line which has an address.
+static void read_listing(const char *fn) {
+    FILE *f = fopen(fn, "r");
+    if (!f) { perror(fn); exit(1); }
+    char line[512];
+    int pending_start = label_count;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        while (isspace((unsigned char) *p)) p++;
+        while (isdigit((unsigned char) *p)) p++; // line number
+        while (*p == ' ') p++;
+
+        bool has_addr = false;
+        unsigned addr = 0;
+        char *q = p;
+        while (isxdigit((unsigned char) *q)) q++;
+        if (q - p == 8 && *q == ' ') {
+            has_addr = true;
+            addr = strtoul(p, NULL, 16) & 0xFFFF;
+        }
+
+        // the source text starts at a fixed column
+        char *src = strlen(line) > 40 ? line + 40 : line + strlen(line);
+        if (!strncmp(src, "<", 1)) {
+            while (*src && *src != '>') src++;
+            if (*src) src++;
+        }
+        while (isspace((unsigned char) *src)) src++;
+
+        if (has_addr) {
+            for (int i = pending_start; i < label_count; i++) labels[i].addr = addr;
+            pending_start = label_count;
+            char *comment = strchr(src, ';');
+            if (comment != NULL) parse_annotation(comment, addr);
+        }
+
+        // labels: an identifier followed by a colon, at the start of the line
+        char *e = src;
+        while (isalnum((unsigned char) *e) || *e == '_' || *e == '.') e++;
+        if (e > src && *e == ':' && label_count < MAX_LABELS && !isdigit((unsigned char) *src)) {
+            label_t *l = &labels[label_count++];
+            size_t n = e - src < (long) sizeof(l->name) - 1 ? (size_t) (e - src) : sizeof(l->name) - 1;
+            memcpy(l->name, src, n);
+            l->name[n] = 0;
+            if (has_addr) {
+                l->addr = addr;
+                pending_start = label_count;
+            }
+        }
+    }
+    fclose(f);
+}
+
+static bool is_stop(uint16_t ip) {
+    for (int i = 0; i < stop_count; i++) {
+        if (stops[i] == ip) return true;
+    }
+    return false;
+}
+
+static long walk(uint16_t ip, int depth, bool first);
+
+// Follow a branch to "target", unless it is a loop which has run out of
+// iterations. Returns -1 if the branch cannot be taken.
+static long walk_taken(uint16_t ip, uint16_t target, int depth) {
+    const annot_t *a = &annots[ip];
+    if (is_stop(target)) return 0;
+    if (a->type == ANNOT_COUNT) {
+        if (taken_count[ip] >= a->count) return -1;
+        taken_count[ip]++;
+        long r = walk(target, depth, false);
+        taken_count[ip]--;
+        return r;
+    }
+    // a function called twice is on the path twice, but is not a loop
+    if (target <= ip && on_path[target]) {
+        fprintf(stderr, "%s: unbounded loop", label_at(ip));
+        fprintf(stderr, " to %s; annotate it with '; wcet: N'\n", label_at(target));
+        failed = true;
+        return -1;
+    }
+    return walk(target, depth, false);
+}
+
+static long walk(uint16_t ip, int depth, bool first) {
+    if (failed) return 0;
+    if (!first && is_stop(ip)) return 0;
+
+    v30mz_insn_t insn;
+    if (ip >= code_size || !v30mz_decode(code, code_size, ip, &insn) || insn.flow == V30MZ_FLOW_UNKNOWN) {
+        fprintf(stderr, "%s: cannot follow instruction\n", label_at(ip));
+        failed = true;
+        return 0;
+    }
+    const annot_t *a = &annots[ip];
+    if (a->type == ANNOT_STOP) return 0;
+
+    long cost = insn.cycles;
+    if (insn.rep) {
+        if (a->type != ANNOT_COUNT) {
+            fprintf(stderr, "%s: unbounded REP; annotate it with '; wcet: N'\n", label_at(ip));
+            failed = true;
+            return 0;
+        }
+        cost = 1 + (long) insn.cycles * a->count;
+    }
+    uint16_t next = ip + insn.length;
+    long best = -1, r;
+
+    on_path[ip]++;
+    switch (insn.flow) {
+    case V30MZ_FLOW_NEXT:
+        best = cost + walk(next, depth, false);
+        break;
+    case V30MZ_FLOW_JUMP:
+        r = walk_taken(ip, insn.target, depth);
+        if (r >= 0) best = cost + r;
+        else if (!failed) {
+            fprintf(stderr, "%s: jump annotated as never taken\n", label_at(ip));
+            failed = true;
+        }
+        break;
+    case V30MZ_FLOW_BRANCH:
+        if (a->type != ANNOT_NOT_TAKEN) {
+            r = walk_taken(ip, insn.target, depth);
+            if (r >= 0) best = insn.cycles_taken + r;
+        }
+        if (a->type != ANNOT_TAKEN) {
+            r = insn.cycles + walk(next, depth, false);
+            if (r > best) best = r;
+        }
+        break;
+    case V30MZ_FLOW_CALL:
+        if (depth >= MAX_DEPTH) {
+            fprintf(stderr, "%s: calls nested too deeply\n", label_at(ip));
+            failed = true;
+            break;
+        }
+        call_stack[depth] = next;
+        best = cost + walk(insn.target, depth + 1, false);
+        break;
+    case V30MZ_FLOW_RET:
+        best = cost;
+        if (depth > 0) best += walk(call_stack[depth - 1], depth - 1, false);
+        break;
+    case V30MZ_FLOW_FAR:
+    case V30MZ_FLOW_HALT:
+        best = cost;
+        break;
+    }
+    on_path[ip]--;
+    return best < 0 ? 0 : best;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s -l bootfriend.lst bootfriend.bin NAME=ENTRY[,STOP...]:BUDGET...\n"
+        "  ENTRY and STOP are labels or hexadecimal addresses; the analysis of\n"
+        "  ENTRY fails if its worst case exceeds BUDGET cycles (0 = no budget).\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *listing_fn = NULL;
+    int argi = 1;
+    if (argi + 1 < argc && !strcmp(argv[argi], "-l")) {
+        listing_fn = argv[argi + 1];
+        argi += 2;
+    }
+    if (argc - argi < 2) { usage(argv[0]); return 1; }
+
+    FILE *f = fopen(argv[argi], "rb");
+    if (!f) { perror(argv[argi]); return 1; }
+    code_size = fread(code, 1, sizeof(code), f);
+    fclose(f);
+    if (listing_fn != NULL) read_listing(listing_fn);
+
+    int result = 0;
+    for (argi++; argi < argc; argi++) {
+        char spec[256];
+        snprintf(spec, sizeof(spec), "%s", argv[argi]);
+        char *eq = strchr(spec, '=');
+        char *colon = strrchr(spec, ':');
+        if (eq == NULL || colon == NULL || colon < eq) { usage(argv[0]); return 1; }
+        *eq = 0;
+        *colon = 0;
+        long budget = strtol(colon + 1, NULL, 0);
+
+        uint16_t entry;
+        stop_count = 0;
+        char *tok = strtok(eq + 1, ",");
+        if (!parse_address(tok, &entry)) {
+            fprintf(stderr, "%s: unknown label %s\n", spec, tok);
+            return 1;
+        }
+        while ((tok = strtok(NULL, ",")) != NULL) {
+            if (stop_count >= MAX_STOPS || !parse_address(tok, &stops[stop_count++])) {
+                fprintf(stderr, "%s: unknown label %s\n", spec, tok);
+                return 1;
+            }
+        }
+
+        failed = false;
+        long cycles = walk(entry, 0, true);
+        if (failed) {
+            result = 1;
+            continue;
+        }
+        bool over = budget > 0 && cycles > budget;
+        printf("%-8s %5ld cycles", spec, cycles);
+        if (budget > 0) printf(" (budget %ld)%s", budget, over ? " - OVER BUDGET" : "");
+        printf("\n");
+        if (over) result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,620 @@
+/**
+ * BootFriend - headless load-time harness
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Boots bootfriend.bin from a stub BIOS which calls its VBlank handler
+// every frame, then feeds it a .bfb over an emulated serial port (or
+// stores it in cartridge SRAM) and times the transfer until the payload's
+// entry point is reached.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "v30mz.h"
+
+#define CPU_CLOCK 3072000
+#define CYCLES_PER_FRAME (256 * 159)
+
+#define SOH 1
+#define STX 2
+#define EOT 4
+#define ENQ 5
+#define ACK 6
+#define NAK 21
+#define SYN 22
+#define CAN 24
+
+#define BIOS_STUB_VBLANK 0x0400
+#define BIOS_STUB_IDLE   0x0410
+#define BIOS_HWINT_BASE  0x08
+
+#define BFB_FIRST_BLOCK  (0x6800 - 4)
+#define BFB_SEGMENTED_HEADER_SIZE 1024
+
+typedef struct {
+    uint8_t iram[0x10000];
+    uint8_t sram[4][0x10000];
+    uint8_t ports[0x100];
+    uint8_t keys_y;
+
+    uint8_t hwint_latched;
+    uint64_t next_vblank;
+
+    /* device -> host */
+    uint64_t tx_busy_until;
+    /* host -> device */
+    uint8_t rx_data;
+    bool rx_full;
+    bool rx_overrun;
+    uint8_t *link_data;
+    uint64_t *link_time;
+    uint32_t link_len, link_pos, link_cap;
+} ws_t;
+
+static ws_t ws;
+static v30mz_t cpu;
+
+/* --- scripted XMODEM host --- */
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint16_t block_size;
+    uint32_t latency;
+    double error_rate;
+
+    uint32_t pos;
+    uint32_t pos_sent;
+    uint8_t id;
+    uint16_t cur_size;
+    enum { H_WAIT_START, H_WAIT_ACK, H_WAIT_EOT_ACK, H_DONE, H_FAILED, H_WAIT_RESUME } state;
+    int retries;
+    int kill_after;
+    uint32_t kills;
+    uint8_t block_delta, block_errors;
+    uint32_t collisions;
+    uint8_t resume_reply[5];
+    int resume_len;
+
+    uint64_t block_start;
+    uint64_t block_last_byte;
+    uint32_t blocks, retransmits, errors_injected;
+    uint64_t cycles_block_total, cycles_block_min, cycles_block_max;
+    uint64_t cycles_turnaround_total, cycles_turnaround_max;
+    uint64_t first_byte_time;
+} host_t;
+
+static host_t host;
+
+/* BFEMU_TRACE: on a CPU fault, print the last 64 CS:IP values.
+   BFEMU_TRACEALL: print every instruction executed. */
+#define TRACE_SIZE 64
+static uint16_t trace_cs[TRACE_SIZE], trace_ip[TRACE_SIZE];
+static uint32_t trace_pos;
+static bool trace_all;
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t cycles_per_byte(void) {
+    /* 8N1: ten bits per byte */
+    uint32_t baud = (ws.ports[0xB3] & 0x40) ? 38400 : 9600;
+    return CPU_CLOCK / (baud / 10);
+}
+
+static void link_push(uint8_t v, uint64_t when) {
+    if (ws.link_len >= ws.link_cap) {
+        ws.link_cap = ws.link_cap ? ws.link_cap * 2 : 4096;
+        ws.link_data = realloc(ws.link_data, ws.link_cap);
+        ws.link_time = realloc(ws.link_time, ws.link_cap * sizeof(uint64_t));
+    }
+    /* bytes follow each other back-to-back on the wire */
+    uint64_t prev = ws.link_len > ws.link_pos ? ws.link_time[ws.link_len - 1] : 0;
+    if (when < prev + cycles_per_byte()) when = prev + cycles_per_byte();
+    if (host.error_rate > 0 && (rng_next() % 1000000) < (uint32_t) (host.error_rate * 1000000)) {
+        uint8_t c = v ^ (1 << (rng_next() & 7));
+        host.block_delta += (uint8_t) (c - v);
+        host.block_errors++;
+        v = c;
+        host.errors_injected++;
+    }
+    ws.link_data[ws.link_len] = v;
+    ws.link_time[ws.link_len] = when;
+    ws.link_len++;
+}
+
+static void host_send_block(uint64_t now) {
+    uint32_t remaining = host.size - host.pos;
+    uint16_t size = host.block_size;
+    if (size == 1024 && remaining <= 896) size = 128;
+    host.cur_size = size;
+
+    uint64_t t = now + host.latency;
+    host.block_delta = 0;
+    host.block_errors = 0;
+    host.block_start = t;
+    if (host.first_byte_time == 0) host.first_byte_time = t;
+    bool kill = host.kill_after >= 0 && host.blocks == (uint32_t) host.kill_after;
+    if (kill) size /= 2;
+    link_push(size == 1024 ? STX : SOH, t);
+    link_push(host.id, t);
+    link_push(host.id ^ 0xFF, t);
+    uint8_t checksum = 0;
+    for (uint16_t i = 0; i < size; i++) {
+        uint8_t v = (host.pos + i < host.size) ? host.data[host.pos + i] : 0x1A;
+        checksum += v;
+        link_push(v, t);
+    }
+    if (kill) {
+        /* the host dies mid-block, is restarted and asks where to resume */
+        host.kill_after = -1;
+        host.kills++;
+        host.state = H_WAIT_RESUME;
+        host.resume_len = 0;
+        link_push(ENQ, ws.link_time[ws.link_len - 1] + CPU_CLOCK);
+        return;
+    }
+    link_push(checksum, t);
+    host.block_last_byte = ws.link_time[ws.link_len - 1];
+}
+
+/* The file offset a 'bS' transfer is at, from the load pointer and the
+   number of segments the loader has yet to start. */
+static uint32_t segmented_offset(uint16_t ptr, uint8_t left) {
+    uint8_t count = host.data[6];
+    if (left >= count) return (uint16_t) (ptr - BFB_FIRST_BLOCK);
+    uint32_t pos = BFB_SEGMENTED_HEADER_SIZE;
+    const uint8_t *seg = host.data + 8;
+    for (int i = 0; i < count - 1 - left; i++, seg += 6)
+        pos += seg[2] | (seg[3] << 8);
+    return pos + (uint16_t) (ptr - (seg[0] | (seg[1] << 8)));
+}
+
+static void host_resume(uint64_t now) {
+    uint8_t id = host.resume_reply[1];
+    uint16_t ptr = host.resume_reply[2] | (host.resume_reply[3] << 8);
+    uint16_t base = host.data[2] | (host.data[3] << 8);
+    uint16_t header = 4;
+    if (host.data[1] == 'Z') { base = host.data[4] | (host.data[5] << 8); header = 6; }
+    else if (base == 0xFFFF) base = 0x6800;
+    host.id = id;
+    /* block IDs wrap, so only the load pointer tells a fresh loader apart:
+       it is at the first block, with no 'bS' segment table read yet */
+    if (ptr == BFB_FIRST_BLOCK && (host.data[1] != 'S' || host.resume_reply[4] == 0)) host.pos = 0;
+    else if (host.data[1] == 'S') host.pos = segmented_offset(ptr, host.resume_reply[4]);
+    else host.pos = (uint32_t) (ptr - base + header);
+    host.retries = 0;
+    if (host.pos >= host.size) {
+        host.state = H_WAIT_EOT_ACK;
+        link_push(EOT, now + host.latency);
+    } else {
+        host.state = H_WAIT_ACK;
+        host_send_block(now);
+    }
+}
+
+static void host_on_byte(uint8_t v, uint64_t now) {
+    switch (host.state) {
+    case H_WAIT_RESUME:
+        if (host.resume_len == 0 && v != SYN) break;
+        host.resume_reply[host.resume_len++] = v;
+        /* segments left are only reported by a DEV loader, for 'bS' files */
+        if (host.resume_len == (host.data[1] == 'S' ? 5 : 4)) host_resume(now);
+        break;
+    case H_WAIT_START:
+        if (v == NAK) {
+            host.state = H_WAIT_ACK;
+            host_send_block(now);
+        }
+        break;
+    case H_WAIT_ACK:
+        if (v == ACK) {
+            if (host.block_errors && !host.block_delta) host.collisions++;
+            uint64_t dt = now - host.block_start;
+            uint64_t ta = now - host.block_last_byte;
+            host.blocks++;
+            host.cycles_block_total += dt;
+            if (host.cycles_block_min == 0 || dt < host.cycles_block_min) host.cycles_block_min = dt;
+            if (dt > host.cycles_block_max) host.cycles_block_max = dt;
+            host.cycles_turnaround_total += ta;
+            if (ta > host.cycles_turnaround_max) host.cycles_turnaround_max = ta;
+            host.pos += host.cur_size;
+            host.id++;
+            host.retries = 0;
+            if (host.pos >= host.size) {
+                host.state = H_WAIT_EOT_ACK;
+                link_push(EOT, now + host.latency);
+            } else {
+                host_send_block(now);
+            }
+        } else if (v == NAK) {
+            host.retransmits++;
+            if (++host.retries > 10) {
+                link_push(CAN, now + host.latency);
+                link_push(CAN, now + host.latency);
+                host.state = H_WAIT_RESUME;
+                host.resume_len = 0;
+                host.kills++;
+                link_push(ENQ, now + CPU_CLOCK);
+            } else {
+                host_send_block(now);
+            }
+        } else if (v == CAN) {
+            host.state = H_FAILED;
+        }
+        break;
+    case H_WAIT_EOT_ACK:
+        if (v == ACK) host.state = H_DONE;
+        else if (v == NAK) link_push(EOT, now + host.latency);
+        break;
+    default:
+        break;
+    }
+}
+
+/* --- WonderSwan hardware --- */
+
+static uint8_t hwint_status(void) {
+    uint8_t level = 0;
+    if (ws.rx_full) level |= 0x08;
+    if (cpu.cycles >= ws.tx_busy_until) level |= 0x01;
+    return (ws.hwint_latched | level) & ws.ports[0xB2];
+}
+
+static uint8_t mem_read(v30mz_t *c, uint32_t addr) {
+    if (addr < 0x10000) return ws.iram[addr];
+    if (addr < 0x20000) return ws.sram[ws.ports[0xC1] & 3][addr & 0xFFFF];
+    return 0xFF;
+}
+
+static void mem_write(v30mz_t *c, uint32_t addr, uint8_t value) {
+    if (addr < 0x10000) ws.iram[addr] = value;
+    else if (addr < 0x20000) ws.sram[ws.ports[0xC1] & 3][addr & 0xFFFF] = value;
+}
+
+static uint8_t port_in(v30mz_t *c, uint16_t port) {
+    port &= 0xFF;
+    switch (port) {
+    case 0xB1:
+        ws.rx_full = false;
+        return ws.rx_data;
+    case 0xB3:
+        return (ws.ports[0xB3] & 0xC0)
+            | (ws.rx_full ? 0x01 : 0)
+            | (ws.rx_overrun ? 0x02 : 0)
+            | (cpu.cycles >= ws.tx_busy_until ? 0x04 : 0);
+    case 0xB4:
+        return hwint_status();
+    case 0xB5: {
+        uint8_t v = ws.ports[0xB5] & 0x70;
+        if (v & 0x10) v |= ws.keys_y;
+        return v;
+    }
+    }
+    return ws.ports[port];
+}
+
+static void port_out(v30mz_t *c, uint16_t port, uint8_t value) {
+    port &= 0xFF;
+    switch (port) {
+    case 0xB1:
+        if (cpu.cycles >= ws.tx_busy_until) {
+            ws.tx_busy_until = cpu.cycles + cycles_per_byte();
+            host_on_byte(value, ws.tx_busy_until);
+        }
+        return;
+    case 0xB3:
+        if (value & 0x20) ws.rx_overrun = false;
+        ws.ports[0xB3] = value & 0xC0;
+        return;
+    case 0xB6:
+        ws.hwint_latched &= ~value;
+        return;
+    }
+    ws.ports[port] = value;
+}
+
+static void ws_update(void) {
+    while (ws.link_pos < ws.link_len && ws.link_time[ws.link_pos] <= cpu.cycles) {
+        if (ws.rx_full) ws.rx_overrun = true;
+        ws.rx_data = ws.link_data[ws.link_pos++];
+        ws.rx_full = true;
+    }
+    if (cpu.cycles >= ws.next_vblank) {
+        ws.hwint_latched |= 0x40;
+        ws.next_vblank += CYCLES_PER_FRAME;
+    }
+    uint8_t status = hwint_status();
+    if (status && (cpu.flags & V30MZ_FLAG_IF)) {
+        uint8_t idx = 7;
+        while (!(status & (1 << idx))) idx--;
+        v30mz_interrupt(&cpu, (ws.ports[0xB0] & 0xF8) + idx);
+    }
+}
+
+static uint64_t ws_next_event(void) {
+    uint64_t t = ws.next_vblank;
+    if (ws.link_pos < ws.link_len && ws.link_time[ws.link_pos] < t) t = ws.link_time[ws.link_pos];
+    if (ws.tx_busy_until > cpu.cycles && ws.tx_busy_until < t) t = ws.tx_busy_until;
+    return t;
+}
+
+static void bios_init(const uint8_t *splash, size_t splash_size) {
+    memcpy(ws.iram + 0x6000, splash, splash_size);
+    uint16_t vbl_ofs = splash[0x18] | (splash[0x19] << 8);
+    uint16_t vbl_seg = splash[0x1A] | (splash[0x1B] << 8);
+
+    static const uint8_t stub_vblank[] = {
+        0x50, 0x9A, 0, 0, 0, 0, 0xB0, 0xFF, 0xE6, 0xB6, 0x58, 0xCF
+    };
+    static const uint8_t stub_idle[] = { 0xFB, 0xF4, 0xEB, 0xFC };
+    memcpy(ws.iram + BIOS_STUB_VBLANK, stub_vblank, sizeof(stub_vblank));
+    ws.iram[BIOS_STUB_VBLANK + 2] = vbl_ofs;
+    ws.iram[BIOS_STUB_VBLANK + 3] = vbl_ofs >> 8;
+    ws.iram[BIOS_STUB_VBLANK + 4] = vbl_seg;
+    ws.iram[BIOS_STUB_VBLANK + 5] = vbl_seg >> 8;
+    memcpy(ws.iram + BIOS_STUB_IDLE, stub_idle, sizeof(stub_idle));
+
+    uint16_t vec = (BIOS_HWINT_BASE + 6) * 4;
+    ws.iram[vec] = BIOS_STUB_VBLANK & 0xFF;
+    ws.iram[vec + 1] = BIOS_STUB_VBLANK >> 8;
+    ws.iram[vec + 2] = 0;
+    ws.iram[vec + 3] = 0;
+
+    ws.ports[0xB0] = BIOS_HWINT_BASE;
+    ws.ports[0xC1] = 0xFF; /* don't assume which SRAM bank is mapped */
+    ws.ports[0xB2] = 0x40;
+    ws.next_vblank = CYCLES_PER_FRAME;
+
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.read = mem_read;
+    cpu.write = mem_write;
+    cpu.in = port_in;
+    cpu.out = port_out;
+    v30mz_reset(&cpu);
+    cpu.s[SEG_CS] = 0;
+    cpu.ip = BIOS_STUB_IDLE;
+    cpu.r[REG_SP] = 0x0800;
+}
+
+static uint8_t *read_file(const char *fn, size_t *size) {
+    FILE *f = fopen(fn, "rb");
+    if (!f) { perror(fn); exit(1); }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *d = malloc(*size ? *size : 1);
+    if (fread(d, 1, *size, f) != *size) { perror(fn); exit(1); }
+    fclose(f);
+    return d;
+}
+
+/* A 'bF' payload of random data; only its entry point is ever executed. */
+static uint8_t *make_payload(uint16_t address, size_t size) {
+    uint8_t *d = malloc(size + 4);
+    d[0] = 'b';
+    d[1] = 'F';
+    d[2] = address;
+    d[3] = address >> 8;
+    for (size_t i = 0; i < size; i++) d[i + 4] = rng_next();
+    return d;
+}
+
+/* A 'bS' payload of random data: a segment in SRAM bank 1, "size" bytes
+   (rounded down to whole blocks) at "address", and a short final segment
+   in SRAM bank 3. */
+static uint8_t *make_segmented_payload(uint16_t address, size_t *size) {
+    static const uint16_t sram_len[2] = { 8192, 1000 };
+    uint16_t iram_len = *size & ~1023;
+    if (iram_len == 0) iram_len = 1024;
+    *size = BFB_SEGMENTED_HEADER_SIZE + sram_len[0] + iram_len + sram_len[1];
+    uint8_t *d = calloc(*size, 1);
+    uint8_t *seg = d + 8;
+    d[0] = 'b';
+    d[1] = 'S';
+    d[2] = address;
+    d[3] = address >> 8;
+    d[6] = 3;
+    seg[0] = 0x00; seg[1] = 0x00; seg[2] = sram_len[0]; seg[3] = sram_len[0] >> 8; seg[4] = 1;
+    seg += 6;
+    seg[0] = address; seg[1] = address >> 8; seg[2] = iram_len; seg[3] = iram_len >> 8; seg[4] = 0xFF;
+    seg += 6;
+    seg[0] = 0x00; seg[1] = 0x80; seg[2] = sram_len[1]; seg[3] = sram_len[1] >> 8; seg[4] = 3;
+    for (size_t i = BFB_SEGMENTED_HEADER_SIZE; i < *size; i++) d[i] = rng_next();
+    return d;
+}
+
+/* Compare a 'bS' payload's segments against IRAM and SRAM. */
+static bool check_segmented_payload(const uint8_t *d, size_t size) {
+    size_t pos = BFB_SEGMENTED_HEADER_SIZE;
+    const uint8_t *seg = d + 8;
+    for (int i = 0; i < d[6]; i++, seg += 6) {
+        uint16_t addr = seg[0] | (seg[1] << 8);
+        uint16_t len = seg[2] | (seg[3] << 8);
+        const uint8_t *mem = seg[4] == 0xFF ? ws.iram : ws.sram[seg[4] & 3];
+        for (uint16_t j = 0; j < len && pos < size; j++, pos++) {
+            if (mem[(uint16_t) (addr + j)] != d[pos]) {
+                fprintf(stderr, "payload mismatch in segment %d at %04X\n", i, (uint16_t) (addr + j));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] bootfriend.bin [payload.bfb]\n"
+        "  -b SIZE    XMODEM block size: 128 (default) or 1024\n"
+        "  -l USEC    host turnaround latency (default 1000)\n"
+        "  -e RATE    per-byte error rate, 0..1 (default 0)\n"
+        "  -k KEYS    Y keys held (bitmask, default 0)\n"
+        "  -m MODE    serial (default), or sram: store the payload in cartridge\n"
+        "             SRAM bank 0 instead of sending it (boot it with -k 8)\n"
+        "  -n BYTES   without payload.bfb, send this much random data (default 38400)\n"
+        "  -a ADDR    ... to this address (default 0x6800)\n"
+        "  -f FORMAT  ... as a bF (default) or bS file; bS adds segments in SRAM\n"
+        "             banks 1 and 3 around it\n"
+        "  -x FILE    expected memory image of the payload, as a 'bF' .bfb file\n"
+        "             (default: payload.bfb itself, unless it is compressed)\n"
+        "  -c N       kill the host during block N+1, then resume the transfer\n"
+        "  -s SEED    random seed\n"
+        "  -t SECS    give up after this much emulated time (default 600)\n", name);
+}
+
+int main(int argc, char **argv) {
+    host.block_size = 128;
+    host.id = 1;
+    host.kill_after = -1;
+    double latency_us = 1000;
+    int time_limit = 600;
+    const char *expect_fn = NULL;
+    bool sram_mode = false;
+    size_t payload_size = 38400;
+    uint16_t payload_address = 0x6800;
+    bool segmented = false;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        char opt = argv[argi][1];
+        if (argi + 1 >= argc) { usage(argv[0]); return 1; }
+        const char *val = argv[++argi];
+        switch (opt) {
+        case 'b': host.block_size = atoi(val); break;
+        case 'l': latency_us = atof(val); break;
+        case 'e': host.error_rate = atof(val); break;
+        case 'k': ws.keys_y = strtol(val, NULL, 0); break;
+        case 'm':
+            if (!strcmp(val, "sram")) sram_mode = true;
+            else if (strcmp(val, "serial")) { usage(argv[0]); return 1; }
+            break;
+        case 'x': expect_fn = val; break;
+        case 'n': payload_size = strtoul(val, NULL, 0); break;
+        case 'a': payload_address = strtoul(val, NULL, 0); break;
+        case 'f':
+            if (!strcmp(val, "bS")) segmented = true;
+            else if (strcmp(val, "bF")) { usage(argv[0]); return 1; }
+            break;
+        case 'c': host.kill_after = atoi(val); break;
+        case 's': rng_state = strtoul(val, NULL, 0) | 1; break;
+        case 't': time_limit = atoi(val); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (argc - argi < 1) { usage(argv[0]); return 1; }
+
+    size_t splash_size;
+    uint8_t *splash = read_file(argv[argi], &splash_size);
+    if (splash_size > 0x780) splash_size = 0x780;
+    uint8_t *payload;
+    if (argc - argi >= 2) {
+        payload = read_file(argv[argi + 1], &payload_size);
+    } else if (segmented) {
+        payload = make_segmented_payload(payload_address, &payload_size);
+    } else {
+        payload = make_payload(payload_address, payload_size);
+        payload_size += 4;
+    }
+
+    host.data = payload;
+    host.size = payload_size;
+    host.latency = (uint32_t) (latency_us * CPU_CLOCK / 1000000.0);
+    bios_init(splash, splash_size);
+    if (sram_mode) {
+        memcpy(ws.sram[0], payload, payload_size < 0x10000 ? payload_size : 0x10000);
+        host.state = H_DONE;
+    }
+    trace_all = getenv("BFEMU_TRACEALL") != NULL;
+
+    uint16_t entry_cs = 0, entry_ip = 0;
+    uint16_t load_addr = payload[2] | (payload[3] << 8);
+    if (payload[1] == 'S') { entry_ip = load_addr; entry_cs = payload[4] | (payload[5] << 8); }
+    else if (load_addr == 0xFFFF) { entry_cs = 0x0680; entry_ip = 0; load_addr = 0x6800; }
+    else entry_ip = load_addr;
+
+    uint64_t limit = (uint64_t) CPU_CLOCK * time_limit;
+    bool done = false;
+    while (cpu.cycles < limit) {
+        if (host.state == H_DONE && cpu.s[SEG_CS] == entry_cs && cpu.ip == entry_ip) { done = true; break; }
+        if (cpu.fault) {
+            fprintf(stderr, "CPU fault at %04X:%04X\n", cpu.s[SEG_CS], cpu.ip);
+            if (getenv("BFEMU_TRACE"))
+                for (int i = 0; i < TRACE_SIZE; i++)
+                    fprintf(stderr, " %04X:%04X", trace_cs[(trace_pos + i) % TRACE_SIZE], trace_ip[(trace_pos + i) % TRACE_SIZE]);
+            break;
+        }
+        if (cpu.halted) {
+            uint64_t t = ws_next_event();
+            if (t > cpu.cycles) cpu.cycles = t;
+        } else {
+            trace_cs[trace_pos % TRACE_SIZE] = cpu.s[SEG_CS];
+            trace_ip[trace_pos % TRACE_SIZE] = cpu.ip;
+            trace_pos++;
+            if (trace_all) fprintf(stderr, "%04X:%04X AX=%04X SP=%04X\n", cpu.s[SEG_CS], cpu.ip, cpu.r[REG_AX], cpu.r[REG_SP]);
+            v30mz_step(&cpu);
+        }
+        ws_update();
+        if (host.state == H_FAILED && ws.link_pos >= ws.link_len && cpu.cycles > ws.link_time[ws.link_len - 1] + CPU_CLOCK) break;
+    }
+
+    int result = 0;
+    if (!done) {
+        fprintf(stderr, "payload did not start (host state %d, CS:IP %04X:%04X)\n", host.state, cpu.s[SEG_CS], cpu.ip);
+        result = 1;
+    } else if (payload[1] == 'S') {
+        if (!check_segmented_payload(payload, payload_size)) result = 1;
+    } else if (expect_fn != NULL || payload[1] == 'F') {
+        size_t expect_size = payload_size;
+        uint8_t *expect = expect_fn != NULL ? read_file(expect_fn, &expect_size) : payload;
+        uint16_t addr = expect[2] | (expect[3] << 8);
+        if (addr == 0xFFFF) addr = 0x6800;
+        for (size_t i = 4; i < expect_size; i++) {
+            if (ws.iram[(uint16_t) (addr + i - 4)] != expect[i]) {
+                fprintf(stderr, "payload mismatch at %04X\n", (uint16_t) (addr + i - 4));
+                result = 1;
+                break;
+            }
+        }
+        if (expect != payload) free(expect);
+    }
+
+    double total_s = (double) cpu.cycles / CPU_CLOCK;
+    printf("payload:      %u bytes, %u-byte blocks\n", host.size, host.block_size);
+    printf("blocks:       %u (%u retransmits, %u corrupted bytes, %u resumes)\n", host.blocks, host.retransmits, host.errors_injected, host.kills);
+    if (host.blocks) {
+        printf("block:        avg %llu, min %llu, max %llu cycles\n",
+            (unsigned long long) (host.cycles_block_total / host.blocks),
+            (unsigned long long) host.cycles_block_min, (unsigned long long) host.cycles_block_max);
+        printf("turnaround:   avg %llu, max %llu cycles (last byte in -> ACK out)\n",
+            (unsigned long long) (host.cycles_turnaround_total / host.blocks),
+            (unsigned long long) host.cycles_turnaround_max);
+        printf("per byte:     %.1f cycles\n", (double) (cpu.cycles - host.first_byte_time) / host.size);
+    }
+    if (host.collisions) printf("collisions:   %u blocks ACKed despite corruption\n", host.collisions);
+    printf("total:        %llu cycles (%.3f s) cable -> payload\n", (unsigned long long) cpu.cycles, total_s);
+    printf("result:       %s\n", result ? "FAIL" : "OK");
+    return result;
+}
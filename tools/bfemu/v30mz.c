@@ -0,0 +1,784 @@
+/**
+ * BootFriend - minimal V30MZ (80186 subset) core for host-side tools
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <string.h>
+#include "v30mz.h"
+
+/* Approximate V30MZ cycle counts: {register form, memory form}. Branches
+   report the not-taken cost here and the taken cost in v30mz_decode(). */
+typedef struct {
+    uint8_t reg, mem;
+} timing_t;
+
+static const timing_t timings[256] = {
+    /* 0x00 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{2,2},{3,3},
+    /* 0x08 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{2,2},{0,0},
+    /* 0x10 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{2,2},{3,3},
+    /* 0x18 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{2,2},{3,3},
+    /* 0x20 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{1,1},{10,10},
+    /* 0x28 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{1,1},{10,10},
+    /* 0x30 */ {1,3},{1,3},{1,2},{1,2},{1,1},{1,1},{1,1},{9,9},
+    /* 0x38 */ {1,2},{1,2},{1,2},{1,2},{1,1},{1,1},{1,1},{9,9},
+    /* 0x40 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x48 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x50 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x58 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x60 */ {9,9},{8,8},{12,13},{0,0},{0,0},{0,0},{0,0},{0,0},
+    /* 0x68 */ {1,1},{4,5},{1,1},{4,5},{6,6},{6,6},{7,7},{7,7},
+    /* 0x70 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x78 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0x80 */ {1,3},{1,3},{1,3},{1,3},{1,2},{1,2},{3,5},{3,5},
+    /* 0x88 */ {1,1},{1,1},{1,1},{1,1},{1,3},{1,1},{2,3},{1,3},
+    /* 0x90 */ {1,1},{3,3},{3,3},{3,3},{3,3},{3,3},{3,3},{3,3},
+    /* 0x98 */ {1,1},{1,1},{10,10},{1,1},{2,2},{3,3},{4,4},{2,2},
+    /* 0xA0 */ {1,1},{1,1},{1,1},{1,1},{5,5},{5,5},{6,6},{6,6},
+    /* 0xA8 */ {1,1},{1,1},{3,3},{3,3},{3,3},{3,3},{4,4},{4,4},
+    /* 0xB0 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0xB8 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0xC0 */ {3,5},{3,5},{6,6},{6,6},{6,6},{6,6},{1,1},{1,1},
+    /* 0xC8 */ {8,8},{2,2},{9,9},{8,8},{9,9},{10,10},{6,6},{10,10},
+    /* 0xD0 */ {1,3},{1,3},{3,5},{3,5},{17,17},{6,6},{8,8},{5,5},
+    /* 0xD8 */ {1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},{1,1},
+    /* 0xE0 */ {3,3},{3,3},{2,2},{1,1},{6,6},{6,6},{6,6},{6,6},
+    /* 0xE8 */ {5,5},{4,4},{7,7},{4,4},{6,6},{6,6},{6,6},{6,6},
+    /* 0xF0 */ {1,1},{0,0},{1,1},{1,1},{9,9},{4,4},{1,3},{1,3},
+    /* 0xF8 */ {4,4},{4,4},{4,4},{4,4},{4,4},{4,4},{1,3},{1,3}
+};
+
+static uint8_t taken_cycles(uint8_t op) {
+    if (op >= 0x70 && op <= 0x7F) return 4;
+    switch (op) {
+    case 0xE0: case 0xE1: return 6;
+    case 0xE2: return 5;
+    case 0xE3: return 4;
+    }
+    return 0;
+}
+
+/* Cost of group opcodes, indexed by the ModRM reg field. */
+static void group_timing(uint8_t op, uint8_t modrm, timing_t *t) {
+    uint8_t sub = (modrm >> 3) & 7;
+    if ((op >= 0x80 && op <= 0x83) && sub == 7) { t->reg = 1; t->mem = 2; }
+    else if (op == 0xF6 || op == 0xF7) {
+        static const timing_t f6[8] = {{1,2},{1,2},{1,3},{1,3},{3,4},{3,4},{15,16},{17,18}};
+        static const timing_t f7[8] = {{1,2},{1,2},{1,3},{1,3},{3,4},{3,4},{23,24},{24,25}};
+        *t = (op == 0xF6) ? f6[sub] : f7[sub];
+    } else if (op == 0xFF) {
+        static const timing_t ff[8] = {{1,3},{1,3},{5,6},{12,12},{4,5},{11,11},{1,3},{1,3}};
+        *t = ff[sub];
+    }
+}
+
+static bool has_modrm(uint8_t op) {
+    if (op < 0x40) return (op & 4) == 0;
+    switch (op) {
+    case 0x62: case 0x69: case 0x6B:
+    case 0x80: case 0x81: case 0x82: case 0x83:
+    case 0x84: case 0x85: case 0x86: case 0x87:
+    case 0x88: case 0x89: case 0x8A: case 0x8B:
+    case 0x8C: case 0x8D: case 0x8E: case 0x8F:
+    case 0xC0: case 0xC1: case 0xC4: case 0xC5: case 0xC6: case 0xC7:
+    case 0xD0: case 0xD1: case 0xD2: case 0xD3:
+    case 0xF6: case 0xF7: case 0xFE: case 0xFF:
+        return true;
+    }
+    return (op >= 0xD8 && op <= 0xDF);
+}
+
+/* Immediate operand size, excluding the ModRM/displacement bytes. */
+static uint8_t imm_size(uint8_t op, uint8_t modrm) {
+    if (op < 0x40) {
+        if ((op & 7) == 4) return 1;
+        if ((op & 7) == 5) return 2;
+        return 0;
+    }
+    if (op >= 0x70 && op <= 0x7F) return 1;
+    if (op >= 0xB0 && op <= 0xB7) return 1;
+    if (op >= 0xB8 && op <= 0xBF) return 2;
+    if (op >= 0xE0 && op <= 0xE7) return 1;
+    switch (op) {
+    case 0x68: case 0x69: case 0x81: case 0xC7: case 0xA9:
+    case 0xA0: case 0xA1: case 0xA2: case 0xA3:
+    case 0xC2: case 0xCA: case 0xE8: case 0xE9:
+        return 2;
+    case 0x6A: case 0x6B: case 0x80: case 0x82: case 0x83: case 0xC6:
+    case 0xA8: case 0xC0: case 0xC1: case 0xCD: case 0xD4: case 0xD5: case 0xEB:
+        return 1;
+    case 0x9A: case 0xEA:
+        return 4;
+    case 0xC8:
+        return 3;
+    case 0xF6:
+        return ((modrm >> 3) & 7) < 2 ? 1 : 0;
+    case 0xF7:
+        return ((modrm >> 3) & 7) < 2 ? 2 : 0;
+    }
+    return 0;
+}
+
+static uint8_t modrm_disp_size(uint8_t modrm) {
+    uint8_t mod = modrm >> 6;
+    if (mod == 0) return ((modrm & 7) == 6) ? 2 : 0;
+    if (mod == 1) return 1;
+    if (mod == 2) return 2;
+    return 0;
+}
+
+static inline uint8_t byte_at(const uint8_t *code, uint32_t code_size, uint16_t ofs) {
+    return ofs < code_size ? code[ofs] : 0;
+}
+
+bool v30mz_decode(const uint8_t *code, uint32_t code_size, uint16_t ip, v30mz_insn_t *insn) {
+#define BYTE_AT(i) byte_at(code, code_size, ip + (i))
+    uint8_t len = 0;
+    uint8_t prefix_cycles = 0;
+    memset(insn, 0, sizeof(*insn));
+
+    uint8_t op = BYTE_AT(len++);
+    while (op == 0x26 || op == 0x2E || op == 0x36 || op == 0x3E || op == 0xF0 || op == 0xF2 || op == 0xF3) {
+        if (op == 0xF2 || op == 0xF3) insn->rep = true;
+        prefix_cycles++;
+        if (len > 6) return false;
+        op = BYTE_AT(len++);
+    }
+
+    uint8_t modrm = 0;
+    bool mem = false;
+    if (has_modrm(op)) {
+        modrm = BYTE_AT(len++);
+        mem = (modrm >> 6) != 3;
+        len += modrm_disp_size(modrm);
+    }
+    uint8_t imm_ofs = len;
+    len += imm_size(op, modrm);
+    insn->length = len;
+
+    timing_t t = timings[op];
+    group_timing(op, modrm, &t);
+    insn->cycles = prefix_cycles + (mem ? t.mem : t.reg);
+    insn->cycles_taken = prefix_cycles + taken_cycles(op);
+    if (insn->rep && ((op >= 0xA4 && op <= 0xA7) || (op >= 0xAA && op <= 0xAF) || (op >= 0x6C && op <= 0x6F))) {
+        /* per-element cost; the prefix is accounted once by the caller */
+        insn->cycles = mem ? t.mem : t.reg;
+    } else {
+        insn->rep = false;
+    }
+
+    uint16_t next = ip + len;
+    insn->flow = V30MZ_FLOW_NEXT;
+    if ((op >= 0x70 && op <= 0x7F) || (op >= 0xE0 && op <= 0xE3)) {
+        insn->flow = V30MZ_FLOW_BRANCH;
+        insn->target = next + (int8_t) BYTE_AT(imm_ofs);
+    } else if (op == 0xEB) {
+        insn->flow = V30MZ_FLOW_JUMP;
+        insn->target = next + (int8_t) BYTE_AT(imm_ofs);
+    } else if (op == 0xE9 || op == 0xE8) {
+        insn->flow = (op == 0xE8) ? V30MZ_FLOW_CALL : V30MZ_FLOW_JUMP;
+        insn->target = next + (int16_t) (BYTE_AT(imm_ofs) | (BYTE_AT(imm_ofs + 1) << 8));
+    } else if (op == 0xC2 || op == 0xC3) {
+        insn->flow = V30MZ_FLOW_RET;
+    } else if (op == 0x9A || op == 0xEA || op == 0xCA || op == 0xCB || op == 0xCF || op == 0xCC || op == 0xCD) {
+        insn->flow = (op == 0xCD || op == 0xCC || op == 0x9A) ? V30MZ_FLOW_NEXT : V30MZ_FLOW_FAR;
+    } else if (op == 0xF4) {
+        insn->flow = V30MZ_FLOW_HALT;
+    } else if (op == 0xFF) {
+        uint8_t sub = (modrm >> 3) & 7;
+        if (sub == 2 || sub == 4) insn->flow = V30MZ_FLOW_UNKNOWN;
+        else if (sub == 5) insn->flow = V30MZ_FLOW_FAR;
+    } else if ((op >= 0xD8 && op <= 0xDF) || op == 0x0F || op == 0x63 || op == 0x64 || op == 0x65 || op == 0x66 || op == 0x67 || op == 0xF1) {
+        insn->flow = V30MZ_FLOW_UNKNOWN;
+    }
+    return true;
+#undef BYTE_AT
+}
+
+/* --- execution --- */
+
+#define AL (*((uint8_t*) &cpu->r[REG_AX]))
+#define AH (*(((uint8_t*) &cpu->r[REG_AX]) + 1))
+
+static uint8_t mem_read8(v30mz_t *cpu, uint16_t seg, uint16_t ofs) {
+    return cpu->read(cpu, v30mz_linear(seg, ofs));
+}
+
+static uint16_t mem_read16(v30mz_t *cpu, uint16_t seg, uint16_t ofs) {
+    return mem_read8(cpu, seg, ofs) | (mem_read8(cpu, seg, ofs + 1) << 8);
+}
+
+static void mem_write8(v30mz_t *cpu, uint16_t seg, uint16_t ofs, uint8_t v) {
+    cpu->write(cpu, v30mz_linear(seg, ofs), v);
+}
+
+static void mem_write16(v30mz_t *cpu, uint16_t seg, uint16_t ofs, uint16_t v) {
+    mem_write8(cpu, seg, ofs, v);
+    mem_write8(cpu, seg, ofs + 1, v >> 8);
+}
+
+static uint8_t fetch8(v30mz_t *cpu) {
+    return mem_read8(cpu, cpu->s[SEG_CS], cpu->ip++);
+}
+
+static uint16_t fetch16(v30mz_t *cpu) {
+    uint16_t v = mem_read16(cpu, cpu->s[SEG_CS], cpu->ip);
+    cpu->ip += 2;
+    return v;
+}
+
+static uint8_t reg8_get(v30mz_t *cpu, uint8_t idx) {
+    return (idx < 4) ? (cpu->r[idx] & 0xFF) : (cpu->r[idx - 4] >> 8);
+}
+
+static void reg8_set(v30mz_t *cpu, uint8_t idx, uint8_t v) {
+    if (idx < 4) cpu->r[idx] = (cpu->r[idx] & 0xFF00) | v;
+    else cpu->r[idx - 4] = (cpu->r[idx - 4] & 0x00FF) | (v << 8);
+}
+
+static void push16(v30mz_t *cpu, uint16_t v) {
+    cpu->r[REG_SP] -= 2;
+    mem_write16(cpu, cpu->s[SEG_SS], cpu->r[REG_SP], v);
+}
+
+static uint16_t pop16(v30mz_t *cpu) {
+    uint16_t v = mem_read16(cpu, cpu->s[SEG_SS], cpu->r[REG_SP]);
+    cpu->r[REG_SP] += 2;
+    return v;
+}
+
+typedef struct {
+    uint8_t modrm;
+    bool mem;
+    uint16_t seg, ofs;
+} ea_t;
+
+static void decode_ea(v30mz_t *cpu, ea_t *ea, int seg_override) {
+    uint8_t modrm = fetch8(cpu);
+    uint8_t mod = modrm >> 6;
+    uint8_t rm = modrm & 7;
+    ea->modrm = modrm;
+    ea->mem = mod != 3;
+    if (!ea->mem) return;
+
+    uint16_t ofs = 0;
+    int seg = SEG_DS;
+    switch (rm) {
+    case 0: ofs = cpu->r[REG_BX] + cpu->r[REG_SI]; break;
+    case 1: ofs = cpu->r[REG_BX] + cpu->r[REG_DI]; break;
+    case 2: ofs = cpu->r[REG_BP] + cpu->r[REG_SI]; seg = SEG_SS; break;
+    case 3: ofs = cpu->r[REG_BP] + cpu->r[REG_DI]; seg = SEG_SS; break;
+    case 4: ofs = cpu->r[REG_SI]; break;
+    case 5: ofs = cpu->r[REG_DI]; break;
+    case 6: if (mod == 0) { ofs = fetch16(cpu); } else { ofs = cpu->r[REG_BP]; seg = SEG_SS; } break;
+    case 7: ofs = cpu->r[REG_BX]; break;
+    }
+    if (mod == 1) ofs += (int8_t) fetch8(cpu);
+    else if (mod == 2) ofs += fetch16(cpu);
+    if (seg_override >= 0) seg = seg_override;
+    ea->seg = cpu->s[seg];
+    ea->ofs = ofs;
+}
+
+static uint8_t ea_read8(v30mz_t *cpu, ea_t *ea) {
+    return ea->mem ? mem_read8(cpu, ea->seg, ea->ofs) : reg8_get(cpu, ea->modrm & 7);
+}
+
+static uint16_t ea_read16(v30mz_t *cpu, ea_t *ea) {
+    return ea->mem ? mem_read16(cpu, ea->seg, ea->ofs) : cpu->r[ea->modrm & 7];
+}
+
+static void ea_write8(v30mz_t *cpu, ea_t *ea, uint8_t v) {
+    if (ea->mem) mem_write8(cpu, ea->seg, ea->ofs, v); else reg8_set(cpu, ea->modrm & 7, v);
+}
+
+static void ea_write16(v30mz_t *cpu, ea_t *ea, uint16_t v) {
+    if (ea->mem) mem_write16(cpu, ea->seg, ea->ofs, v); else cpu->r[ea->modrm & 7] = v;
+}
+
+static bool parity(uint8_t v) {
+    v ^= v >> 4; v ^= v >> 2; v ^= v >> 1;
+    return !(v & 1);
+}
+
+static void set_flag(v30mz_t *cpu, uint16_t flag, bool v) {
+    if (v) cpu->flags |= flag; else cpu->flags &= ~flag;
+}
+
+static void set_szp(v30mz_t *cpu, uint32_t res, bool word) {
+    uint16_t mask = word ? 0xFFFF : 0xFF;
+    uint16_t sign = word ? 0x8000 : 0x80;
+    set_flag(cpu, V30MZ_FLAG_ZF, (res & mask) == 0);
+    set_flag(cpu, V30MZ_FLAG_SF, (res & sign) != 0);
+    set_flag(cpu, V30MZ_FLAG_PF, parity(res & 0xFF));
+}
+
+/* 0 ADD, 1 OR, 2 ADC, 3 SBB, 4 AND, 5 SUB, 6 XOR, 7 CMP */
+static uint16_t alu(v30mz_t *cpu, uint8_t op, uint16_t a, uint16_t b, bool word) {
+    uint32_t mask = word ? 0xFFFF : 0xFF;
+    uint32_t sign = word ? 0x8000 : 0x80;
+    uint32_t res = 0;
+    uint32_t carry = (cpu->flags & V30MZ_FLAG_CF) ? 1 : 0;
+    switch (op) {
+    case 0: case 2:
+        res = a + b + (op == 2 ? carry : 0);
+        set_flag(cpu, V30MZ_FLAG_CF, res > mask);
+        set_flag(cpu, V30MZ_FLAG_OF, ((res ^ a) & (res ^ b) & sign) != 0);
+        set_flag(cpu, V30MZ_FLAG_AF, ((res ^ a ^ b) & 0x10) != 0);
+        break;
+    case 3: case 5: case 7:
+        res = a - b - (op == 3 ? carry : 0);
+        set_flag(cpu, V30MZ_FLAG_CF, (res & ~mask) != 0);
+        set_flag(cpu, V30MZ_FLAG_OF, ((a ^ b) & (a ^ res) & sign) != 0);
+        set_flag(cpu, V30MZ_FLAG_AF, ((res ^ a ^ b) & 0x10) != 0);
+        break;
+    case 1: res = a | b; goto Logic;
+    case 4: res = a & b; goto Logic;
+    case 6: res = a ^ b;
+    Logic:
+        set_flag(cpu, V30MZ_FLAG_CF, false);
+        set_flag(cpu, V30MZ_FLAG_OF, false);
+        set_flag(cpu, V30MZ_FLAG_AF, false);
+        break;
+    }
+    set_szp(cpu, res, word);
+    return (op == 7) ? a : (res & mask);
+}
+
+static uint16_t incdec(v30mz_t *cpu, uint16_t a, bool dec, bool word) {
+    uint16_t cf = cpu->flags & V30MZ_FLAG_CF;
+    uint16_t r = alu(cpu, dec ? 5 : 0, a, 1, word);
+    cpu->flags = (cpu->flags & ~V30MZ_FLAG_CF) | cf;
+    return r;
+}
+
+static uint16_t shift(v30mz_t *cpu, uint8_t sub, uint16_t v, uint8_t count, bool word) {
+    uint32_t mask = word ? 0xFFFF : 0xFF;
+    uint32_t sign = word ? 0x8000 : 0x80;
+    uint8_t bits = word ? 16 : 8;
+    count &= 0x1F;
+    if (count == 0) return v;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t cf = (cpu->flags & V30MZ_FLAG_CF) ? 1 : 0;
+        uint32_t nv = v;
+        switch (sub) {
+        case 0: nv = ((v << 1) | (v >> (bits - 1))) & mask; set_flag(cpu, V30MZ_FLAG_CF, v & sign); break;
+        case 1: nv = ((v >> 1) | (v << (bits - 1))) & mask; set_flag(cpu, V30MZ_FLAG_CF, v & 1); break;
+        case 2: nv = ((v << 1) | cf) & mask; set_flag(cpu, V30MZ_FLAG_CF, v & sign); break;
+        case 3: nv = ((v >> 1) | (cf << (bits - 1))) & mask; set_flag(cpu, V30MZ_FLAG_CF, v & 1); break;
+        case 4: case 6: nv = (v << 1) & mask; set_flag(cpu, V30MZ_FLAG_CF, v & sign); break;
+        case 5: nv = v >> 1; set_flag(cpu, V30MZ_FLAG_CF, v & 1); break;
+        case 7: nv = (v >> 1) | (v & sign); set_flag(cpu, V30MZ_FLAG_CF, v & 1); break;
+        }
+        set_flag(cpu, V30MZ_FLAG_OF, ((nv ^ v) & sign) != 0);
+        v = nv;
+    }
+    if (sub >= 4) set_szp(cpu, v, word);
+    return v;
+}
+
+static bool condition(v30mz_t *cpu, uint8_t cc) {
+    uint16_t f = cpu->flags;
+    bool cf = f & V30MZ_FLAG_CF, zf = f & V30MZ_FLAG_ZF, sf = f & V30MZ_FLAG_SF;
+    bool of = f & V30MZ_FLAG_OF, pf = f & V30MZ_FLAG_PF;
+    bool r = false;
+    switch (cc >> 1) {
+    case 0: r = of; break;
+    case 1: r = cf; break;
+    case 2: r = zf; break;
+    case 3: r = cf || zf; break;
+    case 4: r = sf; break;
+    case 5: r = pf; break;
+    case 6: r = sf != of; break;
+    case 7: r = zf || (sf != of); break;
+    }
+    return (cc & 1) ? !r : r;
+}
+
+void v30mz_reset(v30mz_t *cpu) {
+    memset(cpu->r, 0, sizeof(cpu->r));
+    memset(cpu->s, 0, sizeof(cpu->s));
+    cpu->s[SEG_CS] = 0xFFFF;
+    cpu->ip = 0;
+    cpu->flags = 0xF002;
+    cpu->halted = false;
+    cpu->fault = false;
+    cpu->cycles = 0;
+}
+
+static void do_interrupt(v30mz_t *cpu, uint8_t vector) {
+    push16(cpu, cpu->flags);
+    push16(cpu, cpu->s[SEG_CS]);
+    push16(cpu, cpu->ip);
+    cpu->flags &= ~(V30MZ_FLAG_IF | V30MZ_FLAG_TF);
+    cpu->ip = mem_read16(cpu, 0, vector * 4);
+    cpu->s[SEG_CS] = mem_read16(cpu, 0, vector * 4 + 2);
+}
+
+bool v30mz_interrupt(v30mz_t *cpu, uint8_t vector) {
+    if (!(cpu->flags & V30MZ_FLAG_IF)) return false;
+    cpu->halted = false;
+    do_interrupt(cpu, vector);
+    cpu->cycles += 32;
+    return true;
+}
+
+static void string_op(v30mz_t *cpu, uint8_t op, int seg_override) {
+    int16_t delta = (cpu->flags & V30MZ_FLAG_DF) ? -1 : 1;
+    bool word = op & 1;
+    if (word) delta *= 2;
+    uint16_t src_seg = cpu->s[seg_override >= 0 ? seg_override : SEG_DS];
+    switch (op) {
+    case 0xA4: mem_write8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], mem_read8(cpu, src_seg, cpu->r[REG_SI])); break;
+    case 0xA5: mem_write16(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], mem_read16(cpu, src_seg, cpu->r[REG_SI])); break;
+    case 0xA6: alu(cpu, 7, mem_read8(cpu, src_seg, cpu->r[REG_SI]), mem_read8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI]), false); break;
+    case 0xA7: alu(cpu, 7, mem_read16(cpu, src_seg, cpu->r[REG_SI]), mem_read16(cpu, cpu->s[SEG_ES], cpu->r[REG_DI]), true); break;
+    case 0xAA: mem_write8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], AL); break;
+    case 0xAB: mem_write16(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], cpu->r[REG_AX]); break;
+    case 0xAC: AL = mem_read8(cpu, src_seg, cpu->r[REG_SI]); break;
+    case 0xAD: cpu->r[REG_AX] = mem_read16(cpu, src_seg, cpu->r[REG_SI]); break;
+    case 0xAE: alu(cpu, 7, AL, mem_read8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI]), false); break;
+    case 0xAF: alu(cpu, 7, cpu->r[REG_AX], mem_read16(cpu, cpu->s[SEG_ES], cpu->r[REG_DI]), true); break;
+    case 0x6C: mem_write8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], cpu->in(cpu, cpu->r[REG_DX])); break;
+    case 0x6D: mem_write8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI], cpu->in(cpu, cpu->r[REG_DX])); mem_write8(cpu, cpu->s[SEG_ES], cpu->r[REG_DI] + 1, cpu->in(cpu, cpu->r[REG_DX] + 1)); break;
+    case 0x6E: cpu->out(cpu, cpu->r[REG_DX], mem_read8(cpu, src_seg, cpu->r[REG_SI])); break;
+    case 0x6F: cpu->out(cpu, cpu->r[REG_DX], mem_read8(cpu, src_seg, cpu->r[REG_SI])); cpu->out(cpu, cpu->r[REG_DX] + 1, mem_read8(cpu, src_seg, cpu->r[REG_SI] + 1)); break;
+    }
+    switch (op) {
+    case 0xA4: case 0xA5: case 0xA6: case 0xA7: case 0x6E: case 0x6F:
+        cpu->r[REG_SI] += delta;
+        if (op == 0x6E || op == 0x6F) break;
+        /* fall through */
+    case 0xAA: case 0xAB: case 0xAE: case 0xAF: case 0x6C: case 0x6D:
+        cpu->r[REG_DI] += delta;
+        break;
+    case 0xAC: case 0xAD:
+        cpu->r[REG_SI] += delta;
+        break;
+    }
+}
+
+uint32_t v30mz_step(v30mz_t *cpu) {
+    if (cpu->halted || cpu->fault) {
+        cpu->cycles += 1;
+        return 1;
+    }
+
+    uint8_t code[16];
+    for (int i = 0; i < 16; i++) code[i] = mem_read8(cpu, cpu->s[SEG_CS], cpu->ip + i);
+    v30mz_insn_t insn;
+    v30mz_decode(code, 16, 0, &insn);
+
+    uint16_t start_ip = cpu->ip;
+    int seg_override = -1;
+    uint8_t rep = 0;
+    uint8_t op;
+    while (true) {
+        op = fetch8(cpu);
+        if (op == 0x26) seg_override = SEG_ES;
+        else if (op == 0x2E) seg_override = SEG_CS;
+        else if (op == 0x36) seg_override = SEG_SS;
+        else if (op == 0x3E) seg_override = SEG_DS;
+        else if (op == 0xF2 || op == 0xF3) rep = op;
+        else if (op == 0xF0) { }
+        else break;
+    }
+
+    uint32_t cycles = insn.cycles;
+    bool taken = false;
+    ea_t ea;
+    uint16_t a, b;
+
+    if (op < 0x40 && (op & 7) < 6) {
+        uint8_t aop = op >> 3;
+        bool word = op & 1;
+        switch (op & 7) {
+        case 0: case 1:
+            decode_ea(cpu, &ea, seg_override);
+            if (word) { a = ea_read16(cpu, &ea); b = cpu->r[(ea.modrm >> 3) & 7]; a = alu(cpu, aop, a, b, true); if (aop != 7) ea_write16(cpu, &ea, a); }
+            else { a = ea_read8(cpu, &ea); b = reg8_get(cpu, (ea.modrm >> 3) & 7); a = alu(cpu, aop, a, b, false); if (aop != 7) ea_write8(cpu, &ea, a); }
+            break;
+        case 2: case 3:
+            decode_ea(cpu, &ea, seg_override);
+            if (word) { a = cpu->r[(ea.modrm >> 3) & 7]; b = ea_read16(cpu, &ea); cpu->r[(ea.modrm >> 3) & 7] = alu(cpu, aop, a, b, true); }
+            else { a = reg8_get(cpu, (ea.modrm >> 3) & 7); b = ea_read8(cpu, &ea); reg8_set(cpu, (ea.modrm >> 3) & 7, alu(cpu, aop, a, b, false)); }
+            break;
+        case 4: AL = alu(cpu, aop, AL, fetch8(cpu), false); break;
+        case 5: cpu->r[REG_AX] = alu(cpu, aop, cpu->r[REG_AX], fetch16(cpu), true); break;
+        }
+        goto Done;
+    }
+
+    switch (op) {
+    case 0x06: case 0x0E: case 0x16: case 0x1E: push16(cpu, cpu->s[op >> 3]); break;
+    case 0x07: case 0x17: case 0x1F: cpu->s[op >> 3] = pop16(cpu); break;
+    case 0x27: { /* DAA */
+        uint8_t old = AL; bool cf = cpu->flags & V30MZ_FLAG_CF;
+        if ((AL & 0x0F) > 9 || (cpu->flags & V30MZ_FLAG_AF)) { AL += 6; cpu->flags |= V30MZ_FLAG_AF; } else cpu->flags &= ~V30MZ_FLAG_AF;
+        if (old > 0x99 || cf) { AL += 0x60; cpu->flags |= V30MZ_FLAG_CF; } else cpu->flags &= ~V30MZ_FLAG_CF;
+        set_szp(cpu, AL, false);
+    } break;
+    case 0x2F: { /* DAS */
+        uint8_t old = AL; bool cf = cpu->flags & V30MZ_FLAG_CF;
+        if ((AL & 0x0F) > 9 || (cpu->flags & V30MZ_FLAG_AF)) { AL -= 6; cpu->flags |= V30MZ_FLAG_AF; } else cpu->flags &= ~V30MZ_FLAG_AF;
+        if (old > 0x99 || cf) { AL -= 0x60; cpu->flags |= V30MZ_FLAG_CF; } else cpu->flags &= ~V30MZ_FLAG_CF;
+        set_szp(cpu, AL, false);
+    } break;
+    case 0x37: case 0x3F:
+        if ((AL & 0x0F) > 9 || (cpu->flags & V30MZ_FLAG_AF)) {
+            if (op == 0x37) { AL += 6; AH += 1; } else { AL -= 6; AH -= 1; }
+            cpu->flags |= V30MZ_FLAG_AF | V30MZ_FLAG_CF;
+        } else cpu->flags &= ~(V30MZ_FLAG_AF | V30MZ_FLAG_CF);
+        AL &= 0x0F;
+        break;
+    case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
+        cpu->r[op & 7] = incdec(cpu, cpu->r[op & 7], false, true); break;
+    case 0x48: case 0x49: case 0x4A: case 0x4B: case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+        cpu->r[op & 7] = incdec(cpu, cpu->r[op & 7], true, true); break;
+    case 0x50: case 0x51: case 0x52: case 0x53: case 0x55: case 0x56: case 0x57:
+        push16(cpu, cpu->r[op & 7]); break;
+    case 0x54: a = cpu->r[REG_SP]; push16(cpu, a); break;
+    case 0x58: case 0x59: case 0x5A: case 0x5B: case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+        cpu->r[op & 7] = pop16(cpu); break;
+    case 0x60: {
+        uint16_t sp = cpu->r[REG_SP];
+        for (int i = 0; i < 8; i++) push16(cpu, i == REG_SP ? sp : cpu->r[i]);
+    } break;
+    case 0x61:
+        for (int i = 7; i >= 0; i--) { uint16_t v = pop16(cpu); if (i != REG_SP) cpu->r[i] = v; }
+        break;
+    case 0x68: push16(cpu, fetch16(cpu)); break;
+    case 0x6A: push16(cpu, (int8_t) fetch8(cpu)); break;
+    case 0x69: case 0x6B: {
+        decode_ea(cpu, &ea, seg_override);
+        int32_t v = (int16_t) ea_read16(cpu, &ea);
+        int32_t m = (op == 0x69) ? (int16_t) fetch16(cpu) : (int8_t) fetch8(cpu);
+        int32_t res = v * m;
+        cpu->r[(ea.modrm >> 3) & 7] = res;
+        set_flag(cpu, V30MZ_FLAG_CF, res != (int16_t) res);
+        set_flag(cpu, V30MZ_FLAG_OF, res != (int16_t) res);
+    } break;
+    case 0x6C: case 0x6D: case 0x6E: case 0x6F:
+    case 0xA4: case 0xA5: case 0xAA: case 0xAB: case 0xAC: case 0xAD:
+        if (rep) {
+            cycles = 1;
+            while (cpu->r[REG_CX]) {
+                string_op(cpu, op, seg_override);
+                cpu->r[REG_CX]--;
+                cycles += insn.cycles;
+            }
+        } else string_op(cpu, op, seg_override);
+        break;
+    case 0xA6: case 0xA7: case 0xAE: case 0xAF:
+        if (rep) {
+            cycles = 1;
+            while (cpu->r[REG_CX]) {
+                string_op(cpu, op, seg_override);
+                cpu->r[REG_CX]--;
+                cycles += insn.cycles;
+                bool zf = cpu->flags & V30MZ_FLAG_ZF;
+                if ((rep == 0xF3 && !zf) || (rep == 0xF2 && zf)) break;
+            }
+        } else string_op(cpu, op, seg_override);
+        break;
+    case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+    case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E: case 0x7F: {
+        int8_t d = fetch8(cpu);
+        if (condition(cpu, op & 0xF)) { cpu->ip += d; taken = true; }
+    } break;
+    case 0x80: case 0x81: case 0x82: case 0x83: {
+        decode_ea(cpu, &ea, seg_override);
+        uint8_t aop = (ea.modrm >> 3) & 7;
+        if (op == 0x81) { a = ea_read16(cpu, &ea); b = fetch16(cpu); a = alu(cpu, aop, a, b, true); if (aop != 7) ea_write16(cpu, &ea, a); }
+        else if (op == 0x83) { a = ea_read16(cpu, &ea); b = (int8_t) fetch8(cpu); a = alu(cpu, aop, a, b, true); if (aop != 7) ea_write16(cpu, &ea, a); }
+        else { a = ea_read8(cpu, &ea); b = fetch8(cpu); a = alu(cpu, aop, a, b, false); if (aop != 7) ea_write8(cpu, &ea, a); }
+    } break;
+    case 0x84: decode_ea(cpu, &ea, seg_override); alu(cpu, 4, ea_read8(cpu, &ea), reg8_get(cpu, (ea.modrm >> 3) & 7), false); break;
+    case 0x85: decode_ea(cpu, &ea, seg_override); alu(cpu, 4, ea_read16(cpu, &ea), cpu->r[(ea.modrm >> 3) & 7], true); break;
+    case 0x86: decode_ea(cpu, &ea, seg_override); a = ea_read8(cpu, &ea); ea_write8(cpu, &ea, reg8_get(cpu, (ea.modrm >> 3) & 7)); reg8_set(cpu, (ea.modrm >> 3) & 7, a); break;
+    case 0x87: decode_ea(cpu, &ea, seg_override); a = ea_read16(cpu, &ea); ea_write16(cpu, &ea, cpu->r[(ea.modrm >> 3) & 7]); cpu->r[(ea.modrm >> 3) & 7] = a; break;
+    case 0x88: decode_ea(cpu, &ea, seg_override); ea_write8(cpu, &ea, reg8_get(cpu, (ea.modrm >> 3) & 7)); break;
+    case 0x89: decode_ea(cpu, &ea, seg_override); ea_write16(cpu, &ea, cpu->r[(ea.modrm >> 3) & 7]); break;
+    case 0x8A: decode_ea(cpu, &ea, seg_override); reg8_set(cpu, (ea.modrm >> 3) & 7, ea_read8(cpu, &ea)); break;
+    case 0x8B: decode_ea(cpu, &ea, seg_override); cpu->r[(ea.modrm >> 3) & 7] = ea_read16(cpu, &ea); break;
+    case 0x8C: decode_ea(cpu, &ea, seg_override); ea_write16(cpu, &ea, cpu->s[(ea.modrm >> 3) & 3]); break;
+    case 0x8D: decode_ea(cpu, &ea, seg_override); cpu->r[(ea.modrm >> 3) & 7] = ea.ofs; break;
+    case 0x8E: decode_ea(cpu, &ea, seg_override); cpu->s[(ea.modrm >> 3) & 3] = ea_read16(cpu, &ea); break;
+    case 0x8F: decode_ea(cpu, &ea, seg_override); ea_write16(cpu, &ea, pop16(cpu)); break;
+    case 0x90: break;
+    case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
+        a = cpu->r[op & 7]; cpu->r[op & 7] = cpu->r[REG_AX]; cpu->r[REG_AX] = a; break;
+    case 0x98: cpu->r[REG_AX] = (int8_t) AL; break;
+    case 0x99: cpu->r[REG_DX] = (cpu->r[REG_AX] & 0x8000) ? 0xFFFF : 0; break;
+    case 0x9A: {
+        uint16_t ofs = fetch16(cpu), seg = fetch16(cpu);
+        push16(cpu, cpu->s[SEG_CS]); push16(cpu, cpu->ip);
+        cpu->ip = ofs; cpu->s[SEG_CS] = seg;
+    } break;
+    case 0x9B: break;
+    case 0x9C: push16(cpu, cpu->flags); break;
+    case 0x9D: cpu->flags = pop16(cpu) | 0xF002; break;
+    case 0x9E: cpu->flags = (cpu->flags & 0xFF00) | AH | 0x02; break;
+    case 0x9F: AH = cpu->flags & 0xFF; break;
+    case 0xA0: AL = mem_read8(cpu, cpu->s[seg_override >= 0 ? seg_override : SEG_DS], fetch16(cpu)); break;
+    case 0xA1: cpu->r[REG_AX] = mem_read16(cpu, cpu->s[seg_override >= 0 ? seg_override : SEG_DS], fetch16(cpu)); break;
+    case 0xA2: mem_write8(cpu, cpu->s[seg_override >= 0 ? seg_override : SEG_DS], fetch16(cpu), AL); break;
+    case 0xA3: mem_write16(cpu, cpu->s[seg_override >= 0 ? seg_override : SEG_DS], fetch16(cpu), cpu->r[REG_AX]); break;
+    case 0xA8: alu(cpu, 4, AL, fetch8(cpu), false); break;
+    case 0xA9: alu(cpu, 4, cpu->r[REG_AX], fetch16(cpu), true); break;
+    case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB6: case 0xB7:
+        reg8_set(cpu, op & 7, fetch8(cpu)); break;
+    case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+        cpu->r[op & 7] = fetch16(cpu); break;
+    case 0xC0: case 0xC1: case 0xD0: case 0xD1: case 0xD2: case 0xD3: {
+        decode_ea(cpu, &ea, seg_override);
+        uint8_t sub = (ea.modrm >> 3) & 7;
+        uint8_t count = (op <= 0xC1) ? fetch8(cpu) : ((op <= 0xD1) ? 1 : (cpu->r[REG_CX] & 0xFF));
+        if (op & 1) ea_write16(cpu, &ea, shift(cpu, sub, ea_read16(cpu, &ea), count, true));
+        else ea_write8(cpu, &ea, shift(cpu, sub, ea_read8(cpu, &ea), count, false));
+    } break;
+    case 0xC2: a = fetch16(cpu); cpu->ip = pop16(cpu); cpu->r[REG_SP] += a; break;
+    case 0xC3: cpu->ip = pop16(cpu); break;
+    case 0xC4: case 0xC5:
+        decode_ea(cpu, &ea, seg_override);
+        cpu->r[(ea.modrm >> 3) & 7] = mem_read16(cpu, ea.seg, ea.ofs);
+        cpu->s[op == 0xC4 ? SEG_ES : SEG_DS] = mem_read16(cpu, ea.seg, ea.ofs + 2);
+        break;
+    case 0xC6: decode_ea(cpu, &ea, seg_override); ea_write8(cpu, &ea, fetch8(cpu)); break;
+    case 0xC7: decode_ea(cpu, &ea, seg_override); ea_write16(cpu, &ea, fetch16(cpu)); break;
+    case 0xC8: {
+        uint16_t size = fetch16(cpu); uint8_t level = fetch8(cpu) & 0x1F;
+        push16(cpu, cpu->r[REG_BP]);
+        uint16_t frame = cpu->r[REG_SP];
+        for (uint8_t i = 1; i < level; i++) { cpu->r[REG_BP] -= 2; push16(cpu, mem_read16(cpu, cpu->s[SEG_SS], cpu->r[REG_BP])); }
+        if (level) push16(cpu, frame);
+        cpu->r[REG_BP] = frame;
+        cpu->r[REG_SP] -= size;
+    } break;
+    case 0xC9: cpu->r[REG_SP] = cpu->r[REG_BP]; cpu->r[REG_BP] = pop16(cpu); break;
+    case 0xCA: a = fetch16(cpu); cpu->ip = pop16(cpu); cpu->s[SEG_CS] = pop16(cpu); cpu->r[REG_SP] += a; break;
+    case 0xCB: cpu->ip = pop16(cpu); cpu->s[SEG_CS] = pop16(cpu); break;
+    case 0xCC: do_interrupt(cpu, 3); break;
+    case 0xCD: do_interrupt(cpu, fetch8(cpu)); break;
+    case 0xCE: if (cpu->flags & V30MZ_FLAG_OF) do_interrupt(cpu, 4); break;
+    case 0xCF: cpu->ip = pop16(cpu); cpu->s[SEG_CS] = pop16(cpu); cpu->flags = pop16(cpu) | 0xF002; break;
+    case 0xD4: { uint8_t d = fetch8(cpu); if (d == 0) { do_interrupt(cpu, 0); break; } AH = AL / d; AL = AL % d; set_szp(cpu, AL, false); } break;
+    case 0xD5: { uint8_t d = fetch8(cpu); AL = AL + AH * d; AH = 0; set_szp(cpu, AL, false); } break;
+    case 0xD6: AL = (cpu->flags & V30MZ_FLAG_CF) ? 0xFF : 0x00; break;
+    case 0xD7: AL = mem_read8(cpu, cpu->s[seg_override >= 0 ? seg_override : SEG_DS], cpu->r[REG_BX] + AL); break;
+    case 0xE0: case 0xE1: case 0xE2: case 0xE3: {
+        int8_t d = fetch8(cpu);
+        bool t;
+        if (op == 0xE3) t = cpu->r[REG_CX] == 0;
+        else {
+            cpu->r[REG_CX]--;
+            t = cpu->r[REG_CX] != 0;
+            if (op == 0xE0) t = t && !(cpu->flags & V30MZ_FLAG_ZF);
+            if (op == 0xE1) t = t && (cpu->flags & V30MZ_FLAG_ZF);
+        }
+        if (t) { cpu->ip += d; taken = true; }
+    } break;
+    case 0xE4: AL = cpu->in(cpu, fetch8(cpu)); break;
+    case 0xE5: a = fetch8(cpu); cpu->r[REG_AX] = cpu->in(cpu, a) | (cpu->in(cpu, a + 1) << 8); break;
+    case 0xE6: cpu->out(cpu, fetch8(cpu), AL); break;
+    case 0xE7: a = fetch8(cpu); cpu->out(cpu, a, AL); cpu->out(cpu, a + 1, AH); break;
+    case 0xE8: a = fetch16(cpu); push16(cpu, cpu->ip); cpu->ip += a; break;
+    case 0xE9: a = fetch16(cpu); cpu->ip += a; break;
+    case 0xEA: { uint16_t ofs = fetch16(cpu), seg = fetch16(cpu); cpu->ip = ofs; cpu->s[SEG_CS] = seg; } break;
+    case 0xEB: { int8_t d = fetch8(cpu); cpu->ip += d; } break;
+    case 0xEC: AL = cpu->in(cpu, cpu->r[REG_DX]); break;
+    case 0xED: cpu->r[REG_AX] = cpu->in(cpu, cpu->r[REG_DX]) | (cpu->in(cpu, cpu->r[REG_DX] + 1) << 8); break;
+    case 0xEE: cpu->out(cpu, cpu->r[REG_DX], AL); break;
+    case 0xEF: cpu->out(cpu, cpu->r[REG_DX], AL); cpu->out(cpu, cpu->r[REG_DX] + 1, AH); break;
+    case 0xF4: cpu->halted = true; break;
+    case 0xF5: cpu->flags ^= V30MZ_FLAG_CF; break;
+    case 0xF6: case 0xF7: {
+        decode_ea(cpu, &ea, seg_override);
+        uint8_t sub = (ea.modrm >> 3) & 7;
+        bool word = op & 1;
+        uint16_t v = word ? ea_read16(cpu, &ea) : ea_read8(cpu, &ea);
+        switch (sub) {
+        case 0: case 1: alu(cpu, 4, v, word ? fetch16(cpu) : fetch8(cpu), word); break;
+        case 2: if (word) ea_write16(cpu, &ea, ~v); else ea_write8(cpu, &ea, ~v); break;
+        case 3: a = alu(cpu, 5, 0, v, word); if (word) ea_write16(cpu, &ea, a); else ea_write8(cpu, &ea, a); break;
+        case 4: case 5: {
+            if (word) {
+                uint32_t res = (sub == 4) ? (uint32_t) cpu->r[REG_AX] * v : (uint32_t) ((int32_t) (int16_t) cpu->r[REG_AX] * (int16_t) v);
+                cpu->r[REG_AX] = res; cpu->r[REG_DX] = res >> 16;
+                bool of = (sub == 4) ? (cpu->r[REG_DX] != 0) : ((int32_t) res != (int16_t) res);
+                set_flag(cpu, V30MZ_FLAG_CF, of); set_flag(cpu, V30MZ_FLAG_OF, of);
+            } else {
+                uint16_t res = (sub == 4) ? (uint16_t) AL * v : (uint16_t) ((int16_t) (int8_t) AL * (int8_t) v);
+                cpu->r[REG_AX] = res;
+                bool of = (sub == 4) ? (AH != 0) : ((int16_t) res != (int8_t) res);
+                set_flag(cpu, V30MZ_FLAG_CF, of); set_flag(cpu, V30MZ_FLAG_OF, of);
+            }
+        } break;
+        case 6: case 7: {
+            if (v == 0) { do_interrupt(cpu, 0); break; }
+            if (word) {
+                uint32_t n = ((uint32_t) cpu->r[REG_DX] << 16) | cpu->r[REG_AX];
+                if (sub == 6) { uint32_t q = n / v; if (q > 0xFFFF) { do_interrupt(cpu, 0); break; } cpu->r[REG_AX] = q; cpu->r[REG_DX] = n % v; }
+                else { int32_t q = (int32_t) n / (int16_t) v; if (q != (int16_t) q) { do_interrupt(cpu, 0); break; } cpu->r[REG_AX] = q; cpu->r[REG_DX] = (int32_t) n % (int16_t) v; }
+            } else {
+                uint16_t n = cpu->r[REG_AX];
+                if (sub == 6) { uint16_t q = n / v; if (q > 0xFF) { do_interrupt(cpu, 0); break; } AL = q; AH = n % v; }
+                else { int16_t q = (int16_t) n / (int8_t) v; if (q != (int8_t) q) { do_interrupt(cpu, 0); break; } AL = q; AH = (int16_t) n % (int8_t) v; }
+            }
+        } break;
+        }
+    } break;
+    case 0xF8: cpu->flags &= ~V30MZ_FLAG_CF; break;
+    case 0xF9: cpu->flags |= V30MZ_FLAG_CF; break;
+    case 0xFA: cpu->flags &= ~V30MZ_FLAG_IF; break;
+    case 0xFB: cpu->flags |= V30MZ_FLAG_IF; break;
+    case 0xFC: cpu->flags &= ~V30MZ_FLAG_DF; break;
+    case 0xFD: cpu->flags |= V30MZ_FLAG_DF; break;
+    case 0xFE: case 0xFF: {
+        decode_ea(cpu, &ea, seg_override);
+        uint8_t sub = (ea.modrm >> 3) & 7;
+        if (op == 0xFE) {
+            if (sub < 2) ea_write8(cpu, &ea, incdec(cpu, ea_read8(cpu, &ea), sub == 1, false));
+            else cpu->fault = true;
+            break;
+        }
+        switch (sub) {
+        case 0: case 1: ea_write16(cpu, &ea, incdec(cpu, ea_read16(cpu, &ea), sub == 1, true)); break;
+        case 2: a = ea_read16(cpu, &ea); push16(cpu, cpu->ip); cpu->ip = a; break;
+        case 3: push16(cpu, cpu->s[SEG_CS]); push16(cpu, cpu->ip);
+            cpu->ip = mem_read16(cpu, ea.seg, ea.ofs); cpu->s[SEG_CS] = mem_read16(cpu, ea.seg, ea.ofs + 2); break;
+        case 4: cpu->ip = ea_read16(cpu, &ea); break;
+        case 5: a = mem_read16(cpu, ea.seg, ea.ofs); cpu->s[SEG_CS] = mem_read16(cpu, ea.seg, ea.ofs + 2); cpu->ip = a; break;
+        case 6: push16(cpu, ea_read16(cpu, &ea)); break;
+        default: cpu->fault = true; break;
+        }
+    } break;
+    default:
+        cpu->fault = true;
+        cpu->ip = start_ip;
+        break;
+    }
+
+Done:
+    if (taken) cycles = insn.cycles_taken;
+    cpu->cycles += cycles;
+    return cycles;
+}
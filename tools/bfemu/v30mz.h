@@ -0,0 +1,95 @@
+/**
+ * BootFriend - minimal V30MZ (80186 subset) core for host-side tools
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef __V30MZ_H__
+#define __V30MZ_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define V30MZ_FLAG_CF 0x0001
+#define V30MZ_FLAG_PF 0x0004
+#define V30MZ_FLAG_AF 0x0010
+#define V30MZ_FLAG_ZF 0x0040
+#define V30MZ_FLAG_SF 0x0080
+#define V30MZ_FLAG_TF 0x0100
+#define V30MZ_FLAG_IF 0x0200
+#define V30MZ_FLAG_DF 0x0400
+#define V30MZ_FLAG_OF 0x0800
+
+enum { REG_AX, REG_CX, REG_DX, REG_BX, REG_SP, REG_BP, REG_SI, REG_DI };
+enum { SEG_ES, SEG_CS, SEG_SS, SEG_DS };
+
+typedef struct v30mz v30mz_t;
+
+struct v30mz {
+    uint16_t r[8];
+    uint16_t s[4];
+    uint16_t ip;
+    uint16_t flags;
+    bool halted;
+    bool fault;
+    uint64_t cycles;
+
+    void *user;
+    uint8_t (*read)(v30mz_t *cpu, uint32_t addr);
+    void (*write)(v30mz_t *cpu, uint32_t addr, uint8_t value);
+    uint8_t (*in)(v30mz_t *cpu, uint16_t port);
+    void (*out)(v30mz_t *cpu, uint16_t port, uint8_t value);
+};
+
+/* Control flow classes, as reported by v30mz_decode(). */
+#define V30MZ_FLOW_NEXT    0 /* falls through */
+#define V30MZ_FLOW_JUMP    1 /* unconditional near jump to target */
+#define V30MZ_FLOW_BRANCH  2 /* conditional near jump to target, or falls through */
+#define V30MZ_FLOW_CALL    3 /* near call to target */
+#define V30MZ_FLOW_RET     4 /* near return */
+#define V30MZ_FLOW_FAR     5 /* leaves the segment: far jump/call/return, IRET */
+#define V30MZ_FLOW_HALT    6 /* HLT */
+#define V30MZ_FLOW_UNKNOWN 7 /* indirect near jump/call, or invalid opcode */
+
+typedef struct {
+    uint8_t length;
+    uint8_t flow;
+    uint16_t target;
+    /* Cycle cost; "taken" is used for taken branches, "cycles" otherwise.
+       String instructions with a REP prefix report the per-element cost. */
+    uint16_t cycles;
+    uint16_t cycles_taken;
+    bool rep;
+} v30mz_insn_t;
+
+void v30mz_reset(v30mz_t *cpu);
+/* Run one instruction. Returns the number of cycles spent. */
+uint32_t v30mz_step(v30mz_t *cpu);
+/* Raise an interrupt, if IF is set. Returns true if it was taken. */
+bool v30mz_interrupt(v30mz_t *cpu, uint8_t vector);
+/* Decode one instruction without executing it. */
+bool v30mz_decode(const uint8_t *code, uint32_t code_size, uint16_t ip, v30mz_insn_t *insn);
+
+static inline uint32_t v30mz_linear(uint16_t seg, uint16_t ofs) {
+    return (((uint32_t) seg << 4) + ofs) & 0xFFFFF;
+}
+
+#endif /* __V30MZ_H__ */
@@ -0,0 +1,144 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+# Maps a PC-sampling profile sent by a profiling build of the installer
+# ("make -f Makefile.rom PROFILE=1", then "Send profile") back to the
+# functions of its .elf file.
+
+import argparse
+import fnmatch
+import struct
+import sys
+
+# one display line takes 256 cycles of the 3.072 MHz CPU clock
+LINE_SECONDS = 256 / 3072000
+
+STT_FUNC = 2
+
+def read_profile(data):
+    """Return the header fields and the histogram of a profile dump."""
+    if data[0:2] != b"bP" or data[2] != 1:
+        raise Exception("not a version 1 profile dump")
+    shift, count, segment, samples, other, period = struct.unpack("<BHHIIH", data[3:18])
+    if len(data) < 20 + count * 2:
+        raise Exception("profile dump is truncated")
+    histogram = struct.unpack("<%dH" % count, data[20:20 + count * 2])
+    return {"shift": shift, "segment": segment, "samples": samples, "other": other, "period": period}, histogram
+
+def read_symbols(data):
+    """Return a sorted list of (address, size, name) of the functions in an ELF file."""
+    if data[0:4] != b"\x7fELF" or data[5] != 1:
+        raise Exception("not a little-endian ELF file")
+    if data[4] == 1:
+        shoff, = struct.unpack("<I", data[32:36])
+        shentsize, shnum = struct.unpack("<HH", data[46:50])
+        section_format, symbol_format = "<IIIIIIIIII", "<IIIBBH"
+    else:
+        shoff, = struct.unpack("<Q", data[40:48])
+        shentsize, shnum = struct.unpack("<HH", data[58:62])
+        section_format, symbol_format = "<IIQQQQIIQQ", "<IBBHQQ"
+
+    sections = [struct.unpack(section_format, data[shoff + i * shentsize:shoff + i * shentsize + struct.calcsize(section_format)]) for i in range(shnum)]
+    symbols = []
+    for _, type, _, _, offset, size, link, _, _, entsize in sections:
+        if type != 2: # SHT_SYMTAB
+            continue
+        strtab = sections[link]
+        for i in range(size // entsize):
+            fields = struct.unpack(symbol_format, data[offset + i * entsize:offset + i * entsize + struct.calcsize(symbol_format)])
+            if data[4] == 1:
+                name, value, sym_size, info, _, shndx = fields
+            else:
+                name, info, _, shndx, value, sym_size = fields
+            if (info & 0xF) != STT_FUNC or shndx == 0:
+                continue
+            name_start = strtab[4] + name
+            name = data[name_start:data.index(b"\0", name_start)].decode()
+            symbols.append((value, sym_size, name))
+    symbols.sort()
+
+    # symbols without a size extend to the next one
+    result = []
+    for i, (value, sym_size, name) in enumerate(symbols):
+        if sym_size == 0 and i + 1 < len(symbols):
+            sym_size = symbols[i + 1][0] - value
+        result.append((value, sym_size, name))
+    return result
+
+def attribute(histogram, shift, base, symbols):
+    """Spread the samples of each bucket over the functions it overlaps, by size."""
+    totals = {}
+    for bucket, count in enumerate(histogram):
+        if count == 0:
+            continue
+        start = base + (bucket << shift)
+        end = start + (1 << shift)
+        covered = 0
+        overlaps = []
+        for value, size, name in symbols:
+            if value >= end:
+                break
+            overlap = min(end, value + size) - max(start, value)
+            if overlap > 0:
+                overlaps.append((name, overlap))
+                covered += overlap
+        # gaps between functions are padding, not code
+        if covered == 0:
+            overlaps, covered = [("(unknown)", 1)], 1
+        for name, overlap in overlaps:
+            totals[name] = totals.get(name, 0) + count * overlap / covered
+    return totals
+
+def main(args):
+    with open(args.profile, "rb") as f:
+        header, histogram = read_profile(f.read())
+    with open(args.elf, "rb") as f:
+        symbols = read_symbols(f.read())
+
+    # symbols hold either offsets within the code segment, or linear addresses
+    linear = args.linear if args.linear is not None else any(value > 0xFFFF for value, _, _ in symbols)
+    base = header["segment"] << 4 if linear else 0
+    totals = attribute(histogram, header["shift"], base, symbols)
+
+    for pattern in args.group:
+        group = sum(v for k, v in totals.items() if fnmatch.fnmatch(k, pattern))
+        totals = {k: v for k, v in totals.items() if not fnmatch.fnmatch(k, pattern)}
+        if group > 0:
+            totals[pattern] = group
+    if header["other"] > 0:
+        totals["(other segments)"] = header["other"]
+
+    samples = header["samples"]
+    sample_ms = header["period"] * LINE_SECONDS * 1000
+    print("%d samples, one every %d lines (%.3f ms); %.1f s profiled" % (samples, header["period"], sample_ms, samples * sample_ms / 1000))
+    if sum(histogram) + header["other"] < samples:
+        print("warning: some buckets are saturated")
+    print()
+    print("%10s %7s %10s  %s" % ("samples", "%", "ms", "function"))
+    rows = sorted(totals.items(), key=lambda kv: -kv[1])
+    for name, count in rows[:args.count] if args.count > 0 else rows:
+        print("%10.1f %6.2f%% %10.1f  %s" % (count, 100 * count / max(samples, 1), count * sample_ms, name))
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Map a BootFriend installer profile to functions.")
+    parser.add_argument("-g", "--group", action="append", default=[], help="Add up functions matching a pattern, f.e. 'ws_eeprom_*'")
+    parser.add_argument("-n", "--count", type=int, default=30, help="Number of functions to list (0 = all)")
+    parser.add_argument("--linear", action="store_true", default=None, help="Symbols hold linear addresses (default: detect)")
+    parser.add_argument("--offset", dest="linear", action="store_false", help="Symbols hold offsets within the code segment")
+    parser.add_argument("profile", help="Profile dump, as received over XMODEM")
+    parser.add_argument("elf", help="The profiling build's .elf file")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,696 @@
+/**
+ * BootFriend - command-line splash encoder
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Converts PNG images to 1920-byte BootFriend splash data, laid out like
+// bf_generate_bootsplash() in web/index.js does: the template's code,
+// followed by the palettes, the tiles and the tilemap.
+//
+// Unlike the web tool, which assigns palettes greedily in image order,
+// palettes are assigned by a search over the tiles' distinct color sets,
+// which finds an assignment using the fewest palettes whenever one exists.
+// Hardware palettes 4-7 show color 0 as the background color; they are
+// used for 3 colors plus the background.
+
+#include <png.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SPLASH_SIZE 1920
+#define BOOT_TILE_OFFSET 46
+#define MAX_TILES 192
+#define MAX_IMAGE_SIZE 2048
+#define MAX_PALETTES 11 /* hardware palettes 1-11 */
+#define MAX_COLORS 64
+#define SEARCH_LIMIT 4000000
+
+typedef struct {
+    uint16_t background;
+    int name_color;
+    double duration;
+    int name_pos[2][2]; /* horizontal, vertical; x, y */
+    int alignment;
+    int image_offset[2][2];
+    bool inverse_color_correct;
+} settings_t;
+
+typedef struct {
+    uint16_t *pixels; /* 12-bit WS colors */
+    int width, height;
+} image_t;
+
+typedef struct {
+    int bpp;
+    uint8_t *tiles;
+    int tile_count;
+    uint8_t *map;
+    uint8_t palette[(MAX_PALETTES + 1) * 8];
+    int palette_size;
+    int palette_count;
+    int width, height; /* in tiles */
+} tilemap_t;
+
+static bool verbose;
+
+/* --- image loading --- */
+
+static uint16_t color_to_ws(int r, int g, int b, bool inverse_color_correct) {
+    if (inverse_color_correct) {
+        int r2 = r *  124  - g *  20 - b *   4;
+        int g2 = r *   12  + g * 140 - b *  52;
+        int b2 = r * (-36) - g *  20 + b * 156;
+        r = r2 < 0 ? 0 : r2 / 100 > 255 ? 255 : r2 / 100;
+        g = g2 < 0 ? 0 : g2 / 100 > 255 ? 255 : g2 / 100;
+        b = b2 < 0 ? 0 : b2 / 100 > 255 ? 255 : b2 / 100;
+    }
+    return ((r & 0xF0) << 4) | (g & 0xF0) | (b >> 4);
+}
+
+static bool load_image(const char *fn, image_t *image, bool inverse_color_correct) {
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, fn)) {
+        fprintf(stderr, "%s: %s\n", fn, png.message);
+        return false;
+    }
+    png.format = PNG_FORMAT_RGBA;
+    uint8_t *rgba = malloc(PNG_IMAGE_SIZE(png));
+    if (!png_image_finish_read(&png, NULL, rgba, 0, NULL)) {
+        fprintf(stderr, "%s: %s\n", fn, png.message);
+        free(rgba);
+        return false;
+    }
+
+    image->width = png.width;
+    image->height = png.height;
+    image->pixels = malloc(png.width * png.height * sizeof(uint16_t));
+    for (uint32_t i = 0; i < png.width * png.height; i++) {
+        const uint8_t *p = rgba + i * 4;
+        /* fully transparent pixels read back as black from a canvas */
+        image->pixels[i] = p[3] ? color_to_ws(p[0], p[1], p[2], inverse_color_correct) : 0;
+    }
+    free(rgba);
+    return true;
+}
+
+/* --- palette assignment --- */
+
+static bool palette_transparent(int hw) {
+    return hw >= 4 && hw <= 7;
+}
+
+typedef struct {
+    const uint64_t *sets;
+    int set_count;
+    uint64_t background;
+    int count; /* uses hardware palettes 1..count */
+    int capacity[MAX_PALETTES + 1];
+    uint64_t colors[MAX_PALETTES + 1];
+    long nodes;
+} packer_t;
+
+/* The colors a set needs in hardware palette "hw", beyond the ones it
+   already holds. */
+static uint64_t palette_missing(const packer_t *p, int hw, uint64_t set) {
+    if (palette_transparent(hw)) set &= ~p->background;
+    return set & ~p->colors[hw];
+}
+
+/* Depth-first search over the sets, largest first. A set already covered
+   by a palette is never tried elsewhere, and of several empty palettes of
+   the same size only the first is tried. */
+static bool pack_sets(packer_t *p, int i) {
+    if (i == p->set_count) return true;
+    if (++p->nodes > SEARCH_LIMIT) return false;
+
+    uint64_t set = p->sets[i];
+    for (int hw = 1; hw <= p->count; hw++) {
+        if (!palette_missing(p, hw, set)) return pack_sets(p, i + 1);
+    }
+
+    /* try the palettes needing the fewest new colors first */
+    for (int added = 1; added <= 4; added++) {
+        uint32_t empty_tried = 0;
+        for (int hw = 1; hw <= p->count; hw++) {
+            uint64_t missing = palette_missing(p, hw, set);
+            if (__builtin_popcountll(missing) != added) continue;
+            if (__builtin_popcountll(p->colors[hw] | missing) > p->capacity[hw]) continue;
+            if (p->colors[hw] == 0) {
+                if (empty_tried & (1 << p->capacity[hw])) continue;
+                empty_tried |= 1 << p->capacity[hw];
+            }
+            p->colors[hw] |= missing;
+            if (pack_sets(p, i + 1)) return true;
+            p->colors[hw] &= ~missing;
+            if (p->nodes > SEARCH_LIMIT) return false;
+        }
+    }
+    return false;
+}
+
+static int compare_sets(const void *a, const void *b) {
+    uint64_t sa = *(const uint64_t *) a, sb = *(const uint64_t *) b;
+    int d = __builtin_popcountll(sb) - __builtin_popcountll(sa);
+    if (d) return d;
+    return sa < sb ? -1 : sa > sb;
+}
+
+/* Assigns tile color sets to as few hardware palettes as possible, with
+   1 << bpp colors each. Returns the number of palettes used, 0 if they do
+   not fit in MAX_PALETTES, or -1 if the search gave up. */
+static int assign_palettes(uint64_t *sets, int set_count, uint64_t background, int bpp,
+        uint64_t colors[MAX_PALETTES + 1]) {
+    /* drop sets contained in other sets */
+    qsort(sets, set_count, sizeof(uint64_t), compare_sets);
+    int n = 0;
+    for (int i = 0; i < set_count; i++) {
+        bool covered = false;
+        for (int j = 0; j < n && !covered; j++) covered = (sets[i] & ~sets[j]) == 0;
+        if (!covered) sets[n++] = sets[i];
+    }
+
+    packer_t p = { .sets = sets, .set_count = n, .background = background };
+    for (int hw = 1; hw <= MAX_PALETTES; hw++)
+        p.capacity[hw] = palette_transparent(hw) ? (1 << bpp) - 1 : 1 << bpp;
+    uint64_t all = 0;
+    for (int i = 0; i < n; i++) all |= sets[i];
+    bool gave_up = false;
+    int capacity = 0;
+    for (p.count = 1; p.count <= MAX_PALETTES; p.count++) {
+        capacity += p.capacity[p.count];
+        if (__builtin_popcountll(all & ~background) > capacity) continue;
+        memset(p.colors, 0, sizeof(p.colors));
+        p.nodes = 0;
+        if (pack_sets(&p, 0)) {
+            memcpy(colors, p.colors, sizeof(p.colors));
+            return p.count;
+        }
+        if (p.nodes > SEARCH_LIMIT) gave_up = true;
+    }
+    return gave_up ? -1 : 0;
+}
+
+/* --- tile conversion --- */
+
+static uint8_t reverse_bits(uint8_t x) {
+    x = ((x >> 1) & 0x55) | ((x & 0x55) << 1);
+    x = ((x >> 2) & 0x33) | ((x & 0x33) << 2);
+    return (x >> 4) | (x << 4);
+}
+
+static void hflip_tile(uint8_t *dst, const uint8_t *src, int size) {
+    for (int i = 0; i < size; i++) dst[i] = reverse_bits(src[i]);
+}
+
+static void vflip_tile(uint8_t *dst, const uint8_t *src, int bpp) {
+    for (int i = 0; i < 8; i++) memcpy(dst + (7 - i) * bpp, src + i * bpp, bpp);
+}
+
+typedef struct {
+    uint32_t *slots; /* tile number + 1; 0 = empty */
+    uint32_t mask;
+} tile_hash_t;
+
+static uint32_t hash_tile(const uint8_t *t, int size) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < size; i++) h = (h ^ t[i]) * 16777619u;
+    return h;
+}
+
+/* Returns the index of a tile in "tiles", or -1 (and the slot to insert it
+   at in *slot) if there is none. */
+static int find_tile(const tile_hash_t *hash, const uint8_t *tiles, const uint8_t *t, int size, uint32_t *slot) {
+    uint32_t i = hash_tile(t, size) & hash->mask;
+    while (hash->slots[i]) {
+        int idx = hash->slots[i] - 1;
+        if (!memcmp(tiles + idx * size, t, size)) return idx;
+        i = (i + 1) & hash->mask;
+    }
+    if (slot) *slot = i;
+    return -1;
+}
+
+/* Converts an image whose tiles are assigned to palettes to tiles and a
+   tilemap. tile_palette[] holds each tile's hardware palette, slots[] the
+   colors of each palette. */
+static void build_tiles(const image_t *image, int bpp, const uint8_t *tile_palette,
+        const uint16_t slots[MAX_PALETTES + 1][4], int slot_count[MAX_PALETTES + 1], tilemap_t *tm) {
+    int tw = image->width >> 3, th = image->height >> 3;
+    int size = 8 * bpp;
+    tm->tiles = malloc((tw * th + 1) * size);
+    tm->map = malloc(tw * th * 2);
+    tm->tile_count = 0;
+
+    /* the blank tile 0 is stored first, but is not part of the output */
+    tile_hash_t hash;
+    uint32_t hash_size = 64;
+    while (hash_size < (uint32_t) (tw * th + 1) * 2) hash_size <<= 1;
+    hash.slots = calloc(hash_size, sizeof(uint32_t));
+    hash.mask = hash_size - 1;
+    uint8_t *stored = malloc((tw * th + 1) * size);
+    int stored_count = 1;
+    uint32_t slot;
+    memset(stored, 0, size);
+    find_tile(&hash, stored, stored, size, &slot);
+    hash.slots[slot] = 1;
+
+    uint8_t tile[16], variant[3][16];
+    int m = 0;
+    for (int iy = 0; iy < image->height; iy += 8) {
+        for (int ix = 0; ix < image->width; ix += 8, m++) {
+            int hw = tile_palette[m];
+            const uint16_t *pal = slots[hw];
+            for (int ty = 0; ty < 8; ty++) {
+                const uint16_t *row = image->pixels + (iy + ty) * image->width + ix;
+                uint8_t b0 = 0, b1 = 0;
+                for (int tx = 0; tx < 8; tx++) {
+                    int idx = 0;
+                    while (idx < slot_count[hw] - 1 && pal[idx] != row[tx]) idx++;
+                    b0 = (b0 << 1) | (idx & 1);
+                    b1 = (b1 << 1) | (idx >> 1);
+                }
+                tile[ty * bpp] = b0;
+                if (bpp >= 2) tile[ty * bpp + 1] = b1;
+            }
+
+            hflip_tile(variant[0], tile, size);
+            vflip_tile(variant[1], tile, bpp);
+            hflip_tile(variant[2], variant[1], size);
+            int index = find_tile(&hash, stored, tile, size, &slot);
+            int flip = 0;
+            for (int v = 0; v < 3 && index < 0; v++) {
+                index = find_tile(&hash, stored, variant[v], size, NULL);
+                if (index >= 0) flip = v + 1;
+            }
+            if (index < 0) {
+                memcpy(stored + stored_count * size, tile, size);
+                hash.slots[slot] = ++stored_count;
+                index = stored_count - 1;
+            }
+
+            uint16_t entry = (hw << 9) | (flip << 14) | (index ? index - 1 + BOOT_TILE_OFFSET : 0);
+            tm->map[m * 2] = entry & 0xFF;
+            tm->map[m * 2 + 1] = entry >> 8;
+        }
+    }
+    tm->tile_count = stored_count - 1;
+    memcpy(tm->tiles, stored + size, tm->tile_count * size);
+    free(stored);
+    free(hash.slots);
+}
+
+static bool image_to_tilemap(const char *fn, const image_t *image, uint16_t background, tilemap_t *tm) {
+    if ((image->width & 7) || (image->height & 7)) {
+        fprintf(stderr, "%s: image width/height is not a multiple of 8\n", fn);
+        return false;
+    }
+    if (image->width > MAX_IMAGE_SIZE || image->height > MAX_IMAGE_SIZE) {
+        fprintf(stderr, "%s: image width/height too large\n", fn);
+        return false;
+    }
+    int tw = image->width >> 3, th = image->height >> 3;
+
+    /* give every color a bit, and every tile its set of colors */
+    static uint8_t color_bit[4096];
+    uint16_t colors[MAX_COLORS];
+    int color_count = 0;
+    memset(color_bit, 0xFF, sizeof(color_bit));
+    colors[color_count] = background;
+    color_bit[background] = color_count++;
+    uint64_t *tile_sets = malloc(tw * th * sizeof(uint64_t));
+    int too_many = 0, m = 0;
+    for (int iy = 0; iy < image->height; iy += 8) {
+        for (int ix = 0; ix < image->width; ix += 8, m++) {
+            uint64_t set = 0;
+            for (int ty = 0; ty < 8; ty++) {
+                const uint16_t *row = image->pixels + (iy + ty) * image->width + ix;
+                for (int tx = 0; tx < 8; tx++) {
+                    if (color_bit[row[tx]] == 0xFF) {
+                        if (color_count >= MAX_COLORS) {
+                            fprintf(stderr, "%s: image has more than %d colors\n", fn, MAX_COLORS);
+                            free(tile_sets);
+                            return false;
+                        }
+                        colors[color_count] = row[tx];
+                        color_bit[row[tx]] = color_count++;
+                    }
+                    set |= 1ULL << color_bit[row[tx]];
+                }
+            }
+            if (__builtin_popcountll(set) > 4) {
+                if (too_many++ == 0) fprintf(stderr, "%s: image has tiles with more than 4 colors in them:", fn);
+                fprintf(stderr, " %d, %d;", ix, iy);
+            }
+            tile_sets[m] = set;
+        }
+    }
+    if (too_many) {
+        fprintf(stderr, "\n");
+        free(tile_sets);
+        return false;
+    }
+
+    /* prefer 1bpp tiles, if the image has at most 2 colors per tile and
+       the result is not larger */
+    uint64_t *sets = malloc(tw * th * sizeof(uint64_t));
+    uint64_t palette_colors[2][MAX_PALETTES + 1];
+    int palette_count[2] = { 0, 0 };
+    int max_colors = 0;
+    for (int i = 0; i < tw * th; i++)
+        if (__builtin_popcountll(tile_sets[i]) > max_colors) max_colors = __builtin_popcountll(tile_sets[i]);
+    for (int bpp = 1; bpp <= 2; bpp++) {
+        if (max_colors > (1 << bpp)) continue;
+        memcpy(sets, tile_sets, tw * th * sizeof(uint64_t));
+        palette_count[bpp - 1] = assign_palettes(sets, tw * th, 1ULL << color_bit[background], bpp, palette_colors[bpp - 1]);
+    }
+    free(sets);
+
+    int best = -1;
+    int best_size = 0;
+    for (int bpp = 1; bpp <= 2; bpp++) {
+        int count = palette_count[bpp - 1];
+        if (count <= 0) continue;
+
+        /* sort each palette's colors; transparent palettes start with the
+           background color */
+        uint16_t slots[MAX_PALETTES + 1][4];
+        int slot_count[MAX_PALETTES + 1];
+        for (int hw = 1; hw <= count; hw++) {
+            int n = 0;
+            if (palette_transparent(hw)) slots[hw][n++] = background;
+            int first = n;
+            for (int c = 0; c < color_count; c++) {
+                if (!(palette_colors[bpp - 1][hw] & (1ULL << c))) continue;
+                int j = n++;
+                while (j > first && slots[hw][j - 1] > colors[c]) { slots[hw][j] = slots[hw][j - 1]; j--; }
+                slots[hw][j] = colors[c];
+            }
+            slot_count[hw] = n ? n : 1;
+            if (!n) slots[hw][0] = 0;
+        }
+        uint8_t *tile_palette = malloc(tw * th);
+        for (int i = 0; i < tw * th; i++) {
+            int hw = 1;
+            while (hw < count) {
+                uint64_t set = tile_sets[i];
+                if (palette_transparent(hw)) set &= ~(1ULL << color_bit[background]);
+                if (!(set & ~palette_colors[bpp - 1][hw])) break;
+                hw++;
+            }
+            tile_palette[i] = hw;
+        }
+
+        tilemap_t cand = { .bpp = bpp, .width = tw, .height = th, .palette_count = count + 1 };
+        build_tiles(image, bpp, tile_palette, (const uint16_t (*)[4]) slots, slot_count, &cand);
+        free(tile_palette);
+
+        /* palette 0 holds the background color */
+        int entries = 1 << bpp;
+        memset(cand.palette, 0, sizeof(cand.palette));
+        cand.palette[0] = background & 0xFF;
+        cand.palette[1] = background >> 8;
+        for (int hw = 1; hw <= count; hw++) {
+            for (int i = 0; i < slot_count[hw]; i++) {
+                cand.palette[(hw * entries + i) * 2] = slots[hw][i] & 0xFF;
+                cand.palette[(hw * entries + i) * 2 + 1] = slots[hw][i] >> 8;
+            }
+        }
+        cand.palette_size = (count + 1) * entries * 2;
+
+        int size = cand.palette_size + cand.tile_count * 8 * bpp + tw * th * 2;
+        if (best < 0 || size < best_size) {
+            if (best >= 0) { free(tm->tiles); free(tm->map); }
+            *tm = cand;
+            best = bpp;
+            best_size = size;
+        } else {
+            free(cand.tiles);
+            free(cand.map);
+        }
+    }
+    free(tile_sets);
+
+    if (best < 0) {
+        if (palette_count[0] < 0 || palette_count[1] < 0)
+            fprintf(stderr, "%s: gave up searching for a palette assignment\n", fn);
+        else
+            fprintf(stderr, "%s: image does not fit in %d palettes\n", fn, MAX_PALETTES);
+        return false;
+    }
+    return true;
+}
+
+/* --- splash data, as in bf_generate_bootsplash() --- */
+
+static int clamp(int v, int max) {
+    return v > max ? (max < 0 ? 0 : max) : v < 0 ? 0 : v;
+}
+
+static void image_location(const settings_t *s, const tilemap_t *tm, int loc[2][2]) {
+    int hx = 0, hy = 0, vx = 0, vy = 0;
+    int al = s->alignment;
+    if      ((al % 3) == 1) { hx = (28 - tm->width) >> 1; vx = (18 - tm->width) >> 1; }
+    else if ((al % 3) == 2) { hx = 28 - tm->width; vx = 18 - tm->width; }
+    if      ((al / 3) == 1) { hy = (18 - tm->height) >> 1; vy = (28 - tm->height) >> 1; }
+    else if ((al / 3) == 2) { hy = 18 - tm->height; vy = 28 - tm->height; }
+    hx += s->image_offset[0][0];
+    hy += s->image_offset[0][1];
+    vx += s->image_offset[1][0];
+    vy += s->image_offset[1][1];
+    loc[0][0] = clamp(hx, 28 - tm->width);
+    loc[0][1] = clamp(hy, 18 - tm->height);
+    loc[1][0] = clamp(vx, 18 - tm->height);
+    loc[1][1] = clamp(vy, 28 - tm->height);
+}
+
+static void put16(uint8_t *p, int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static bool build_splash(const char *fn, const settings_t *s, const uint8_t *template, int template_size,
+        const tilemap_t *tm, uint8_t *splash, int *size) {
+    memset(splash, 0, SPLASH_SIZE);
+    memcpy(splash, template, template_size);
+    int idx = template_size;
+
+    int end_frame = (int) (s->duration * 75.47 + 0.5);
+    splash[0x04] = s->name_color;
+    splash[0x08] = end_frame < 0x80 ? 0x80 : end_frame > 0xF0 ? 0xF0 : end_frame;
+    splash[0x1C] = s->name_pos[0][1] - 4;
+    splash[0x1D] = s->name_pos[0][0] - 4;
+    splash[0x1E] = s->name_pos[1][0] - 4;
+    splash[0x1F] = 224 - s->name_pos[1][1] - 4;
+
+    splash[0x0A] = (tm->bpp == 2 ? 0x80 : 0x00) | tm->palette_count;
+    if (tm->tile_count > MAX_TILES) {
+        fprintf(stderr, "%s: too many unique tiles in image (%d > %d)\n", fn, tm->tile_count, MAX_TILES);
+        return false;
+    }
+    if (tm->width <= 0 || tm->width > 32 || tm->height <= 0 || tm->height > 32) {
+        fprintf(stderr, "%s: invalid image width/height\n", fn);
+        return false;
+    }
+    splash[0x0B] = tm->tile_count;
+    splash[0x16] = tm->width;
+    splash[0x17] = tm->height;
+
+    int tiles_size = tm->tile_count * 8 * tm->bpp;
+    int map_size = tm->width * tm->height * 2;
+    put16(splash + 0x0C, idx);
+    if (idx + tm->palette_size <= SPLASH_SIZE) memcpy(splash + idx, tm->palette, tm->palette_size);
+    idx += tm->palette_size;
+    put16(splash + 0x0E, idx);
+    if (idx + tiles_size <= SPLASH_SIZE) memcpy(splash + idx, tm->tiles, tiles_size);
+    idx += tiles_size;
+    put16(splash + 0x10, idx);
+    if (idx + map_size <= SPLASH_SIZE) memcpy(splash + idx, tm->map, map_size);
+    idx += map_size;
+
+    int loc[2][2];
+    image_location(s, tm, loc);
+    put16(splash + 0x12, 2 * (loc[0][0] + (loc[0][1] * 32)) + 0x800);
+    put16(splash + 0x14, 2 * ((27 - loc[1][1]) + (loc[1][0] * 32)) + 0x800);
+
+    if (idx > SPLASH_SIZE) {
+        fprintf(stderr, "%s: splash data too large (%d > %d)\n", fn, idx, SPLASH_SIZE);
+        return false;
+    }
+    if (idx <= 0x380) splash[0x06] = 0;
+    *size = idx;
+    return true;
+}
+
+/* --- command line --- */
+
+static uint8_t *read_file(const char *fn, int *size) {
+    FILE *f = fopen(fn, "rb");
+    if (!f) { perror(fn); return NULL; }
+    uint8_t *d = malloc(SPLASH_SIZE);
+    *size = fread(d, 1, SPLASH_SIZE, f);
+    fclose(f);
+    return d;
+}
+
+static bool parse_pair(const char *s, int v[2]) {
+    return sscanf(s, "%d,%d", &v[0], &v[1]) == 2;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Encodes one image; returns 0 on success. */
+static int encode(const char *in_fn, const char *out_fn, const settings_t *s,
+        const uint8_t *template, int template_size) {
+    double start = now_ms();
+    image_t image;
+    if (!load_image(in_fn, &image, s->inverse_color_correct)) return 1;
+    double loaded = now_ms();
+
+    tilemap_t tm;
+    uint8_t splash[SPLASH_SIZE];
+    int size;
+    bool ok = image_to_tilemap(in_fn, &image, s->background, &tm);
+    free(image.pixels);
+    if (!ok) return 1;
+    ok = build_splash(in_fn, s, template, template_size, &tm, splash, &size);
+    double encoded = now_ms();
+    if (ok && verbose) {
+        printf("%s: %dx%d tiles, %dbpp, %d palettes, %d unique tiles, %d/%d bytes (load %.2f ms, encode %.2f ms)\n",
+            in_fn, tm.width, tm.height, tm.bpp, tm.palette_count, tm.tile_count, size, SPLASH_SIZE,
+            loaded - start, encoded - loaded);
+    }
+    free(tm.tiles);
+    free(tm.map);
+    if (!ok) return 1;
+
+    FILE *f = fopen(out_fn, "wb");
+    if (!f || fwrite(splash, 1, SPLASH_SIZE, f) != SPLASH_SIZE) {
+        perror(out_fn);
+        if (f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] -o splash.bin image.png\n"
+        "       %s [options] -O DIR image.png...\n"
+        "  -T FILE    BootFriend template (default bootfriend_template.bin)\n"
+        "  -o FILE    output file, for a single image\n"
+        "  -O DIR     output directory; each image is written to DIR/NAME.bin\n"
+        "  -b RRGGBB  background color (default ffffff)\n"
+        "  -c N       console name color, 0-12 (default 0)\n"
+        "  -d SECS    duration, 1.70-3.25 seconds (default 1.70)\n"
+        "  -a N       image alignment: 0-8, left to right, top to bottom (default 4)\n"
+        "  -x X,Y     image offset in tiles, horizontal (default 0,-1)\n"
+        "  -y X,Y     image offset in tiles, vertical (default 0,-1)\n"
+        "  -n X,Y     console name position, horizontal, or \"off\" (default 112,112)\n"
+        "  -N X,Y     console name position, vertical, or \"off\" (default 72,152)\n"
+        "  -C         apply TFT color correction on import\n"
+        "  -v         print statistics and timings\n", name, name);
+}
+
+int main(int argc, char **argv) {
+    settings_t s = {
+        .background = 0xFFF,
+        .duration = 1.70,
+        .name_pos = { { 112, 112 }, { 72, 152 } },
+        .alignment = 4,
+        .image_offset = { { 0, -1 }, { 0, -1 } },
+    };
+    const char *template_fn = "bootfriend_template.bin";
+    const char *out_fn = NULL, *out_dir = NULL;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        char opt = argv[argi][1];
+        if (opt == 'C') { s.inverse_color_correct = true; continue; }
+        if (opt == 'v') { verbose = true; continue; }
+        if (argi + 1 >= argc) { usage(argv[0]); return 1; }
+        const char *val = argv[++argi];
+        bool ok = true;
+        switch (opt) {
+        case 'T': template_fn = val; break;
+        case 'o': out_fn = val; break;
+        case 'O': out_dir = val; break;
+        case 'b': {
+            unsigned long c = strtoul(val[0] == '#' ? val + 1 : val, NULL, 16);
+            s.background = ((c >> 12) & 0xF00) | ((c >> 8) & 0xF0) | ((c >> 4) & 0x0F);
+        } break;
+        case 'c': s.name_color = atoi(val); ok = s.name_color >= 0 && s.name_color <= 12; break;
+        case 'd': s.duration = atof(val); break;
+        case 'a': s.alignment = atoi(val); ok = s.alignment >= 0 && s.alignment <= 8; break;
+        case 'x': ok = parse_pair(val, s.image_offset[0]); break;
+        case 'y': ok = parse_pair(val, s.image_offset[1]); break;
+        case 'n':
+            if (!strcmp(val, "off")) { s.name_pos[0][0] = 112; s.name_pos[0][1] = 160; }
+            else ok = parse_pair(val, s.name_pos[0]);
+            break;
+        case 'N':
+            if (!strcmp(val, "off")) { s.name_pos[1][0] = 72; s.name_pos[1][1] = -16; }
+            else ok = parse_pair(val, s.name_pos[1]);
+            break;
+        default: ok = false; break;
+        }
+        if (!ok) { usage(argv[0]); return 1; }
+    }
+    int inputs = argc - argi;
+    if (inputs < 1 || (out_dir == NULL) == (out_fn == NULL) || (out_fn != NULL && inputs != 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int template_size;
+    uint8_t *template = read_file(template_fn, &template_size);
+    if (template == NULL) return 1;
+
+    int result = 0;
+    double start = now_ms();
+    for (; argi < argc; argi++) {
+        if (out_fn != NULL) {
+            result |= encode(argv[argi], out_fn, &s, template, template_size);
+            continue;
+        }
+        const char *base = strrchr(argv[argi], '/');
+        base = base ? base + 1 : argv[argi];
+        const char *ext = strrchr(base, '.');
+        int base_len = ext ? (int) (ext - base) : (int) strlen(base);
+        char *fn = malloc(strlen(out_dir) + base_len + 6);
+        sprintf(fn, "%s/%.*s.bin", out_dir, base_len, base);
+        result |= encode(argv[argi], fn, &s, template, template_size);
+        free(fn);
+    }
+    if (verbose && inputs > 1)
+        printf("%d images in %.2f ms\n", inputs, now_ms() - start);
+    free(template);
+    return result;
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Turns a timing trace sent by the installer ("Send timing trace") into a
+# table of per-phase latencies.
+
+import argparse
+import struct
+import sys
+
+# one display line takes 256 cycles of the 3.072 MHz CPU clock
+LINE_SECONDS = 256 / 3072000
+TRACE_END = 0x80
+
+EVENTS = {
+    0x01: "startup",
+    0x02: "ieep_load",
+    0x03: "ieep_write",
+    0x04: "ieep_verify",
+    0x05: "install",
+    0x06: "xmodem_send",
+    0x07: "xmodem_recv",
+    0x08: "xmodem_retry",
+    0x09: "ui_statusbar",
+    0x0A: "ui_menu",
+}
+
+def read_trace(data):
+    """Return a list of (time in lines, event) from a trace dump."""
+    if data[0:2] != b"bT" or data[2] != 1:
+        raise Exception("not a version 1 trace dump")
+    count, entry_size, lines_per_frame, line_vblank = struct.unpack("<HBBB", data[3:8])
+    if len(data) < 8 + count * entry_size:
+        raise Exception("trace dump is truncated")
+
+    events = []
+    last_time = None
+    for i in range(count):
+        ticks, line, event = struct.unpack("<HBB", data[8 + i * entry_size:12 + i * entry_size])
+        # vbl_ticks is incremented at the start of VBlank
+        time = ticks * lines_per_frame + (line - line_vblank) % lines_per_frame
+        if last_time is not None:
+            # unwrap the 16-bit tick counter
+            while time < last_time - 0x8000 * lines_per_frame:
+                time += 0x10000 * lines_per_frame
+            # an event taken with the VBlank interrupt still pending
+            # reads the previous frame's tick count
+            if time < last_time:
+                time += lines_per_frame
+        events.append((time, event))
+        last_time = time
+    return events
+
+def phase_times(events):
+    """Pair begin and end events; return {event: [durations]} and {event: count}."""
+    open_events = {}
+    durations = {}
+    counts = {}
+    for time, event in events:
+        if event & TRACE_END:
+            event &= ~TRACE_END
+            stack = open_events.get(event)
+            # an end without a begin was cut off by the start of the ring
+            if stack:
+                durations.setdefault(event, []).append(time - stack.pop())
+        else:
+            counts[event] = counts.get(event, 0) + 1
+            open_events.setdefault(event, []).append(time)
+    return durations, counts
+
+def print_trace(args, events):
+    durations, counts = phase_times(events)
+
+    if args.events:
+        start = events[0][0] if events else 0
+        for time, event in events:
+            name = EVENTS.get(event & ~TRACE_END, "%02X" % (event & ~TRACE_END))
+            print("%10.3f ms  %s %s" % ((time - start) * LINE_SECONDS * 1000, "end  " if event & TRACE_END else "begin", name))
+        print()
+
+    print("%-14s %6s %10s %10s %10s %10s" % ("phase", "count", "total ms", "mean ms", "min ms", "max ms"))
+    for event in sorted(set(counts) | set(durations)):
+        name = EVENTS.get(event, "%02X" % event)
+        times = durations.get(event)
+        if not times:
+            print("%-14s %6d" % (name, counts.get(event, 0)))
+            continue
+        ms = [t * LINE_SECONDS * 1000 for t in times]
+        print("%-14s %6d %10.3f %10.3f %10.3f %10.3f" % (name, len(ms), sum(ms), sum(ms) / len(ms), min(ms), max(ms)))
+    return durations
+
+def main(args):
+    startup = []
+    for i, fn in enumerate(args.input):
+        with open(fn, "rb") as f:
+            events = read_trace(f.read())
+        if len(args.input) > 1:
+            print("%s%s:" % ("\n" if i > 0 else "", fn))
+        times = print_trace(args, events).get(0x01)
+        startup.append(times[0] * LINE_SECONDS * 1000 if times else None)
+
+    # time to menu, e.g. of builds before and after a change
+    if len(args.input) > 1 and None not in startup:
+        print()
+        for fn, ms in zip(args.input, startup):
+            print("%-30s startup %10.3f ms (%+.3f ms)" % (fn, ms, ms - startup[0]))
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Print per-phase latencies from a BootFriend installer timing trace.")
+    parser.add_argument("-e", "--events", action="store_true", help="Also list every event")
+    parser.add_argument("input", nargs="+", help="Trace dump, as received over XMODEM; with several, their startup times are compared")
+    sys.exit(main(parser.parse_args()))
@@ -46,6 +46,8 @@ def main(args):
         f.write("#include \"util.h\"\n")
         for field_name, data in files.items():
             f.write("\n")
+            if args.align is not None:
+                f.write("__attribute__((aligned(%d)))\n" % args.align)
             f.write("const uint8_t IN_ROM %s[] = {\n" % field_name)
             for i in range(0, len(data), line_step):
                 data_part = data[i:(i + line_step)]
@@ -61,6 +63,7 @@ if __name__ == '__main__':
         description="Convert binary files to a .C/.H pair"
     )
     args_parser.add_argument("--field_name", required=False, type=str, help="Target field name (for one input file).")
+    args_parser.add_argument("--align", required=False, type=int, help="Data alignment, in bytes.")
     args_parser.add_argument("--bank", required=False, type=str, help="Bank (for GBDK)")
     args_parser.add_argument("outc", help="Output C file.")
     args_parser.add_argument("outh", help="Output header file.")
@@ -42,6 +42,12 @@ with open(out_filename, "wb") as fp:
 						fp.write(struct.pack("<B", v | (v << 4)))
 						v = 0
 						vp = 0
+				elif format == '2':
+					# 2bpp planar tile rows, using colors 0 and 1 only
+					if vp >= 8:
+						fp.write(struct.pack("<BB", v, 0))
+						v = 0
+						vp = 0
 				else:
 					if vp >= 8:
 						fp.write(struct.pack("<B", v))
@@ -0,0 +1,187 @@
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "link.h"
+
+// How late (in wall-clock time) a sender may be for its next byte to still
+// count as back-to-back.
+#define LINK_JITTER_NS 200000
+
+typedef struct {
+	uint64_t time;
+	uint8_t value;
+} link_record_t;
+
+static link_config_t config;
+static int sockets[2][2];
+static pthread_t wires[2];
+static uint64_t next_tx[2];
+static uint64_t start_ns;
+static volatile uint32_t corrupted_bytes;
+
+static uint64_t real_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t link_now(void) {
+	return (uint64_t) ((real_now() - start_ns) * config.speedup);
+}
+
+uint64_t link_byte_ns(void) {
+	// 8N1: ten bits per byte
+	return 10000000000ULL / config.baud;
+}
+
+static void link_sleep_until(uint64_t t) {
+	uint64_t real = start_ns + (uint64_t) (t / config.speedup);
+	struct timespec ts;
+	ts.tv_sec = real / 1000000000ULL;
+	ts.tv_nsec = real % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+}
+
+static bool read_full(int fd, void *buf, size_t len) {
+	uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t r = read(fd, p, len);
+		if (r <= 0) {
+			if (r < 0 && errno == EINTR) continue;
+			return false;
+		}
+		p += r;
+		len -= r;
+	}
+	return true;
+}
+
+static void *link_wire_thread(void *arg) {
+	int from = (int) (intptr_t) arg;
+	int to = from ^ 1;
+	unsigned int seed = config.seed * 2 + from;
+	link_record_t rec;
+
+	while (read_full(sockets[from][1], &rec, sizeof(rec))) {
+		link_sleep_until(rec.time + config.latency_ns);
+		if (config.bit_error_rate > 0) {
+			uint8_t value = rec.value;
+			for (int i = 0; i < 8; i++) {
+				if ((rand_r(&seed) / (RAND_MAX + 1.0)) < config.bit_error_rate) {
+					rec.value ^= (1 << i);
+				}
+			}
+			if (rec.value != value) {
+				__atomic_add_fetch(&corrupted_bytes, 1, __ATOMIC_RELAXED);
+			}
+		}
+		if (write(sockets[to][1], &rec.value, 1) != 1) break;
+	}
+	return NULL;
+}
+
+void link_init(const link_config_t *cfg) {
+	config = *cfg;
+	if (config.speedup <= 0) config.speedup = 1;
+	start_ns = real_now();
+	next_tx[0] = next_tx[1] = 0;
+	corrupted_bytes = 0;
+	for (int i = 0; i < 2; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[i]) < 0) {
+			perror("socketpair");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_create(&wires[i], NULL, link_wire_thread, (void*) (intptr_t) i);
+	}
+}
+
+void link_shutdown(void) {
+	for (int i = 0; i < 2; i++) {
+		shutdown(sockets[i][0], SHUT_RDWR);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_join(wires[i], NULL);
+		close(sockets[i][0]);
+		close(sockets[i][1]);
+	}
+}
+
+void link_putc(int endpoint, uint8_t value) {
+	// Bytes sent back-to-back are paced off the previous byte, not the
+	// clock, so that scheduling jitter does not slow the link down.
+	uint64_t now = link_now();
+	uint64_t base = next_tx[endpoint];
+	if (now > base + (uint64_t) (LINK_JITTER_NS * config.speedup)) base = now;
+	uint64_t t = base + link_byte_ns();
+	link_sleep_until(t);
+	next_tx[endpoint] = t;
+
+	link_record_t rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.time = t;
+	rec.value = value;
+	if (write(sockets[endpoint][0], &rec, sizeof(rec)) != sizeof(rec)) {
+		perror("link_putc");
+		exit(1);
+	}
+}
+
+int link_getc(int endpoint, uint64_t timeout_ns) {
+	struct pollfd pfd;
+	pfd.fd = sockets[endpoint][0];
+	pfd.events = POLLIN;
+	int timeout_ms;
+	if (timeout_ns == UINT64_MAX) {
+		timeout_ms = -1;
+	} else {
+		timeout_ms = (int) ((timeout_ns / config.speedup + 999999) / 1000000);
+	}
+
+	int r;
+	while ((r = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) { }
+	if (r <= 0 || !(pfd.revents & POLLIN)) return -1;
+
+	uint8_t value;
+	if (read(pfd.fd, &value, 1) != 1) return -1;
+	return value;
+}
+
+void link_purge(int endpoint, uint64_t quiet_ns) {
+	while (link_getc(endpoint, quiet_ns) >= 0) { }
+}
+
+uint32_t link_corrupted_bytes(void) {
+	return corrupted_bytes;
+}
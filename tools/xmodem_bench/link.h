@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A simulated serial cable between two endpoints, each backed by one end
+// of a socketpair. Every byte is paced at the configured baud rate by its
+// sender, then delayed by the configured latency and subjected to bit
+// errors by a wire thread on its way to the other endpoint.
+//
+// All times are in "link" nanoseconds: wall-clock time multiplied by the
+// speedup factor.
+
+#define LINK_DEVICE 0
+#define LINK_PEER   1
+
+typedef struct {
+	uint32_t baud;
+	double bit_error_rate;
+	uint64_t latency_ns;
+	double speedup;
+	uint32_t seed;
+} link_config_t;
+
+void link_init(const link_config_t *config);
+void link_shutdown(void);
+
+uint64_t link_now(void);
+uint64_t link_byte_ns(void);
+
+/**
+ * Send one byte; returns once the byte has left the sender's UART.
+ */
+void link_putc(int endpoint, uint8_t value);
+
+/**
+ * Receive one byte.
+ * @param timeout_ns Timeout in link nanoseconds; 0 polls, UINT64_MAX waits forever.
+ * @return The byte, or -1 on timeout.
+ */
+int link_getc(int endpoint, uint64_t timeout_ns);
+
+/**
+ * Discard received bytes until the line has been quiet for quiet_ns.
+ */
+void link_purge(int endpoint, uint64_t quiet_ns);
+
+/**
+ * Number of bytes corrupted on the wire so far.
+ */
+uint32_t link_corrupted_bytes(void);
@@ -0,0 +1,172 @@
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "link.h"
+#include "peer.h"
+
+#define SOH 1
+#define STX 2
+#define EOT 4
+#define ACK 6
+#define NAK 21
+#define CAN 24
+
+#define PEER_RETRIES 10
+
+static uint64_t peer_purge_ns(void) {
+	return link_byte_ns() * 4;
+}
+
+static void peer_send_block(uint8_t id, const uint8_t *data, uint32_t avail, uint16_t length) {
+	link_putc(LINK_PEER, length == 1024 ? STX : SOH);
+	link_putc(LINK_PEER, id);
+	link_putc(LINK_PEER, id ^ 0xFF);
+	uint8_t checksum = 0;
+	for (uint16_t i = 0; i < length; i++) {
+		uint8_t v = i < avail ? data[i] : 0x1A;
+		link_putc(LINK_PEER, v);
+		checksum += v;
+	}
+	link_putc(LINK_PEER, checksum);
+}
+
+static bool peer_send(peer_t *peer) {
+	int r;
+
+	// wait for the receiver to start
+	do {
+		r = link_getc(LINK_PEER, peer->timeout_ns * PEER_RETRIES);
+		if (r < 0 || r == CAN) return false;
+	} while (r != NAK);
+
+	uint8_t id = 1;
+	uint32_t pos = 0;
+	while (pos < peer->size) {
+		uint32_t remaining = peer->size - pos;
+		uint16_t length = (peer->use_1k && remaining > 896) ? 1024 : 128;
+		int retries = PEER_RETRIES;
+		while (1) {
+			if (retries-- == 0) {
+				link_putc(LINK_PEER, CAN);
+				return false;
+			}
+			peer_send_block(id, peer->data + pos, remaining, length);
+			do {
+				r = link_getc(LINK_PEER, peer->timeout_ns);
+			} while (r >= 0 && r != ACK && r != NAK && r != CAN);
+			if (r == ACK) break;
+			if (r == CAN) return false;
+			peer->retransmits++;
+			link_purge(LINK_PEER, peer_purge_ns());
+		}
+		peer->blocks++;
+		pos += length;
+		id++;
+	}
+
+	for (int retries = PEER_RETRIES; retries > 0; retries--) {
+		link_putc(LINK_PEER, EOT);
+		r = link_getc(LINK_PEER, peer->timeout_ns);
+		if (r == ACK) return true;
+	}
+	return false;
+}
+
+static bool peer_recv(peer_t *peer) {
+	uint8_t expected = 1;
+	uint32_t pos = 0;
+	int errors = 0;
+	uint8_t response = NAK;
+	static uint8_t block[1024];
+
+	while (errors < PEER_RETRIES) {
+		link_putc(LINK_PEER, response);
+		response = NAK;
+
+		int r = link_getc(LINK_PEER, peer->timeout_ns);
+		if (r == EOT) {
+			link_putc(LINK_PEER, ACK);
+			peer->size = pos;
+			return true;
+		} else if (r == CAN) {
+			return false;
+		} else if (r != SOH && r != STX) {
+			errors++;
+			if (r >= 0) link_purge(LINK_PEER, peer_purge_ns());
+			continue;
+		}
+
+		uint16_t length = (r == STX) ? 1024 : 128;
+		int id = link_getc(LINK_PEER, peer->timeout_ns);
+		int id_inv = link_getc(LINK_PEER, peer->timeout_ns);
+		uint8_t checksum = 0;
+		bool timeout = (id < 0 || id_inv < 0);
+		for (uint16_t i = 0; i < length && !timeout; i++) {
+			int v = link_getc(LINK_PEER, peer->timeout_ns);
+			if (v < 0) timeout = true;
+			block[i] = v;
+			checksum += v;
+		}
+		int checksum_actual = timeout ? -1 : link_getc(LINK_PEER, peer->timeout_ns);
+
+		if (timeout || checksum_actual != checksum || (id ^ id_inv) != 0xFF
+			|| (length == 1024 && peer->reject_1k)) {
+			errors++;
+			peer->retransmits++;
+			link_purge(LINK_PEER, peer_purge_ns());
+			continue;
+		}
+
+		if (id == (uint8_t) (expected - 1)) {
+			// duplicate of the previous block
+			response = ACK;
+			continue;
+		} else if (id != expected) {
+			link_putc(LINK_PEER, CAN);
+			return false;
+		}
+
+		if (pos + length > peer->size) {
+			link_putc(LINK_PEER, CAN);
+			return false;
+		}
+		memcpy(peer->data + pos, block, length);
+		pos += length;
+		expected++;
+		peer->blocks++;
+		errors = 0;
+		response = ACK;
+	}
+
+	link_putc(LINK_PEER, CAN);
+	return false;
+}
+
+void *peer_thread(void *arg) {
+	peer_t *peer = arg;
+	peer->ok = peer->sender ? peer_send(peer) : peer_recv(peer);
+	return NULL;
+}
@@ -0,0 +1,46 @@
+#pragma once
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The host side of the transfer: a conventional XMODEM (checksum)
+// sender or receiver, with timeouts, running on LINK_PEER.
+
+typedef struct {
+	bool sender;
+	bool use_1k;      // sender: send 1K blocks while at least 1K remains
+	bool reject_1k;   // receiver: NAK every 1K block
+	uint8_t *data;    // sender: data to send; receiver: buffer
+	uint32_t size;    // sender: data size; receiver: buffer size, then bytes received
+	uint64_t timeout_ns;
+
+	// results
+	bool ok;
+	uint32_t blocks;
+	uint32_t retransmits;
+} peer_t;
+
+void *peer_thread(void *arg);
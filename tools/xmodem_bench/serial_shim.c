@@ -0,0 +1,102 @@
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "link.h"
+#include "serial.h"
+#include "serial_shim.h"
+
+#define NAK 21
+
+shim_stats_t shim_stats;
+
+static uint64_t stall_timeout = UINT64_MAX;
+static uint64_t last_sent;
+static bool awaiting_response;
+
+void shim_set_stall_timeout(uint64_t timeout_ns) {
+	stall_timeout = timeout_ns;
+}
+
+static void shim_received(uint8_t value) {
+	shim_stats.bytes_received++;
+	if (awaiting_response) {
+		uint64_t dt = link_now() - last_sent;
+		uint32_t bucket = 0;
+		while (bucket < SHIM_HISTOGRAM_BUCKETS - 1 && dt >= (125000ULL << bucket)) {
+			bucket++;
+		}
+		shim_stats.response_histogram[bucket]++;
+		shim_stats.response_total_ns += dt;
+		shim_stats.responses++;
+		if (value == NAK) {
+			shim_stats.naks_received++;
+		}
+		awaiting_response = false;
+	}
+}
+
+void serial_open(uint8_t baudrate) {
+	awaiting_response = false;
+}
+
+void serial_close(void) {
+
+}
+
+int16_t serial_getc_nonblock(void) {
+	int r = link_getc(LINK_DEVICE, 0);
+	if (r >= 0) shim_received(r);
+	return r;
+}
+
+uint8_t serial_getc(void) {
+	int r = link_getc(LINK_DEVICE, stall_timeout);
+	if (r < 0) {
+		fprintf(stderr, "device: stalled waiting for data\n");
+		exit(2);
+	}
+	shim_received(r);
+	return r;
+}
+
+void serial_putc(uint8_t value) {
+	link_putc(LINK_DEVICE, value);
+	last_sent = link_now();
+	awaiting_response = true;
+	shim_stats.bytes_sent++;
+	if (value == NAK) {
+		shim_stats.naks_sent++;
+	}
+}
+
+void serial_flush(void) {
+
+}
+
+// The trace is not part of the benchmark.
+void trace_event(uint8_t event) {
+
+}
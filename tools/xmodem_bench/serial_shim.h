@@ -0,0 +1,47 @@
+#pragma once
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdint.h>
+
+// Statistics gathered by the serial.h implementation used by xmodem.c.
+
+#define SHIM_HISTOGRAM_BUCKETS 12
+
+typedef struct {
+	uint32_t bytes_sent, bytes_received;
+	uint32_t naks_sent, naks_received;
+	// time from the last byte sent to the first byte received after it,
+	// in power-of-two buckets starting at 125 microseconds
+	uint32_t response_histogram[SHIM_HISTOGRAM_BUCKETS];
+	uint64_t response_total_ns;
+	uint32_t responses;
+} shim_stats_t;
+
+extern shim_stats_t shim_stats;
+
+/**
+ * Give up (and exit) if the device waits longer than this for a byte.
+ */
+void shim_set_stall_timeout(uint64_t timeout_ns);
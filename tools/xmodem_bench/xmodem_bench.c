@@ -0,0 +1,182 @@
+/**
+ * BootFriend - XMODEM benchmark
+ *
+ * Copyright (c) 2023 Adrian "asie" Siekierka
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Runs installer/src/xmodem.c against a simulated host over a simulated
+// serial cable, and reports its throughput.
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wonderful.h>
+#include "link.h"
+#include "peer.h"
+#include "serial_shim.h"
+#include "xmodem.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -m send|recv  direction, from the console's point of view (default: recv)\n"
+		"  -n BYTES      transfer size (default: 38400)\n"
+		"  -k            use 1K blocks\n"
+		"  -K            make the host NAK 1K blocks (tests the 128-byte fallback)\n"
+		"  -b BAUD       baud rate (default: 38400)\n"
+		"  -e RATE       bit error rate (default: 0)\n"
+		"  -l MS         one-way cable latency (default: 1)\n"
+		"  -s FACTOR     run faster than real time (default: 1)\n"
+		"  -r SEED       random seed (default: 1)\n", name);
+}
+
+static bool device_recv(uint8_t *buffer, uint32_t capacity, uint32_t *received) {
+	uint32_t pos = 0;
+	xmodem_recv_start();
+	while (1) {
+		uint32_t avail = capacity - pos;
+		uint16_t length = avail > 0xFFFF ? 0xFFFF : avail;
+		uint8_t result = xmodem_recv_block(buffer + pos, &length);
+		if (result == XMODEM_OK) {
+			pos += length;
+			xmodem_recv_ack();
+		} else {
+			*received = pos;
+			return result == XMODEM_COMPLETE;
+		}
+	}
+}
+
+static bool device_send(const uint8_t *data, uint32_t size, bool use_1k) {
+	if (xmodem_send_start() != XMODEM_OK) return false;
+	for (uint32_t pos = 0; pos < size; ) {
+		uint16_t length = (use_1k && size - pos > 896) ? XMODEM_BLOCK_SIZE_1K : XMODEM_BLOCK_SIZE;
+		if (xmodem_send_block(data + pos, length) != XMODEM_OK) return false;
+		pos += length;
+	}
+	return xmodem_send_finish() == XMODEM_OK;
+}
+
+int main(int argc, char **argv) {
+	link_config_t config = {
+		.baud = 38400,
+		.bit_error_rate = 0,
+		.latency_ns = 1000000,
+		.speedup = 1,
+		.seed = 1
+	};
+	bool device_sends = false;
+	bool use_1k = false;
+	bool reject_1k = false;
+	uint32_t size = 38400;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:n:kKb:e:l:s:r:h")) != -1) {
+		switch (opt) {
+		case 'm': device_sends = !strcmp(optarg, "send"); break;
+		case 'n': size = strtoul(optarg, NULL, 0); break;
+		case 'k': use_1k = true; break;
+		case 'K': reject_1k = true; break;
+		case 'b': config.baud = strtoul(optarg, NULL, 0); break;
+		case 'e': config.bit_error_rate = atof(optarg); break;
+		case 'l': config.latency_ns = (uint64_t) (atof(optarg) * 1000000.0); break;
+		case 's': config.speedup = atof(optarg); break;
+		case 'r': config.seed = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	// round up to whole blocks, padded like XMODEM pads
+	uint32_t capacity = (size + 1023) & ~1023;
+	uint8_t *data = malloc(capacity);
+	uint8_t *buffer = calloc(capacity, 1);
+	srand(config.seed);
+	for (uint32_t i = 0; i < size; i++) data[i] = rand();
+	memset(data + size, 0x1A, capacity - size);
+
+	peer_t peer;
+	memset(&peer, 0, sizeof(peer));
+	peer.sender = !device_sends;
+	peer.use_1k = use_1k;
+	peer.reject_1k = reject_1k;
+	peer.data = device_sends ? buffer : data;
+	peer.size = device_sends ? capacity : size;
+
+	link_init(&config);
+	// one second, plus the time a 1K block takes
+	peer.timeout_ns = 1000000000ULL + link_byte_ns() * 1030;
+	shim_set_stall_timeout(peer.timeout_ns * 20);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, peer_thread, &peer);
+
+	uint64_t start = link_now();
+	uint32_t received = 0;
+	bool device_ok = device_sends
+		? device_send(data, size, use_1k)
+		: device_recv(buffer, capacity, &received);
+	pthread_join(thread, NULL);
+	uint64_t elapsed = link_now() - start;
+	link_shutdown();
+
+	uint32_t compare_size = (size + 127) & ~127;
+	bool match = device_ok && peer.ok && !memcmp(data, buffer, compare_size);
+	double seconds = elapsed / 1e9;
+	double line_rate = config.baud / 10.0;
+
+	printf("transfer:     %s, %u bytes, %s blocks%s\n",
+		device_sends ? "console -> host" : "host -> console", size,
+		use_1k ? "1K" : "128-byte", reject_1k ? " (rejected by host)" : "");
+	printf("link:         %u baud, %.2f ms latency, bit error rate %g\n",
+		config.baud, config.latency_ns / 1e6, config.bit_error_rate);
+	printf("time:         %.3f s\n", seconds);
+	printf("throughput:   %.1f bytes/s (%.1f%% of line rate)\n",
+		size / seconds, size / seconds * 100.0 / line_rate);
+	printf("blocks:       %u\n", peer.blocks);
+	printf("retransmits:  %u (%u NAKs %s console)\n", peer.retransmits,
+		device_sends ? shim_stats.naks_received : shim_stats.naks_sent,
+		device_sends ? "received by" : "sent by");
+	printf("corrupted:    %u bytes\n", link_corrupted_bytes());
+	printf("response latency (console's last byte out -> first byte in), avg %.2f ms:\n",
+		shim_stats.responses ? shim_stats.response_total_ns / 1e6 / shim_stats.responses : 0);
+	uint32_t max_count = 1;
+	for (int i = 0; i < SHIM_HISTOGRAM_BUCKETS; i++) {
+		if (shim_stats.response_histogram[i] > max_count) max_count = shim_stats.response_histogram[i];
+	}
+	for (int i = 0; i < SHIM_HISTOGRAM_BUCKETS; i++) {
+		if (!shim_stats.response_histogram[i]) continue;
+		char label[32];
+		if (i == SHIM_HISTOGRAM_BUCKETS - 1) {
+			snprintf(label, sizeof(label), ">= %g ms", (125 << (i - 1)) / 1000.0);
+		} else {
+			snprintf(label, sizeof(label), "< %g ms", (125 << i) / 1000.0);
+		}
+		printf("  %12s %6u ", label, shim_stats.response_histogram[i]);
+		for (uint32_t j = 0; j < shim_stats.response_histogram[i] * 40 / max_count; j++) putchar('#');
+		putchar('\n');
+	}
+	printf("result:       %s\n", match ? "OK" : "FAIL");
+
+	free(data);
+	free(buffer);
+	return match ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// BootFriend for WS - Web configuration utility, installer generation
+// Copyright (c) 2023 Adrian "asie" Siekierka
+//
+// Shared by the page and the batch generator (tools/bfbatch); does not
+// touch the DOM. Generation is driven by a settings object:
+//
+//   color            name color, an index into bf_colors
+//   duration         splash duration, in seconds
+//   nameLocations    [[hx, hy], [vx, vy]], centers of the console name
+//   imageLocations   [[hx, hy], [vx, vy]], top-left tiles of the image
+//   backgroundColor  12-bit RGB
+//   eepromType       0 = BootFriend, 1 = custom IEEPROM data
+//   customEeprom     custom IEEPROM data (Uint8Array), or null
+//   date             installer build date shown in the title
+//   developer        install the developer build of BootFriend, which
+//                    also boots from cartridge SRAM and loads 'bS' files,
+//                    with less room for the splash
+//
+// The installer binaries (bin_bootfriend_*) come from resources.js.
+
+// Where the console name is drawn when it is not enabled for an orientation.
+const bf_default_name_locations = [[112, 160], [72, -16]];
+
+// names: [[hx, hy], [vx, vy]], with null for a disabled orientation.
+function bf_name_locations(names) {
+    return [(names[0] || bf_default_name_locations[0]).slice(), (names[1] || bf_default_name_locations[1]).slice()];
+}
+
+// alignment: 0 - 8, as in the page's image alignment list (top left to
+// bottom right); offsets: [[hx, hy], [vx, vy]], in tiles.
+function bf_image_locations(tm, alignment, offsets) {
+    if (tm == null) return [[31, 31], [31, 31]];
+    var image_hx, image_hy, image_vx, image_vy;
+    var image_al = alignment;
+    if      ((image_al % 3) == 0) { image_hx = 0; image_vx = 0; }
+    else if ((image_al % 3) == 1) { image_hx = (28 - tm.width) >> 1; image_vx = (18 - tm.width) >> 1; }
+    else if ((image_al % 3) == 2) { image_hx = 28 - tm.width; image_vx = 18 - tm.width; }
+    if      (Math.floor(image_al / 3) == 0) { image_hy = 0; image_vy = 0; }
+    else if (Math.floor(image_al / 3) == 1) { image_hy = (18 - tm.height) >> 1; image_vy = (28 - tm.height) >> 1; }
+    else if (Math.floor(image_al / 3) == 2) { image_hy = 18 - tm.height; image_vy = 28 - tm.height; }
+    image_hx += offsets[0][0];
+    image_hy += offsets[0][1];
+    image_vx += offsets[1][0];
+    image_vy += offsets[1][1];
+    image_hx = Math.max(0, Math.min(28 - tm.width, image_hx));
+    image_hy = Math.max(0, Math.min(18 - tm.height, image_hy));
+    image_vx = Math.max(0, Math.min(18 - tm.height, image_vx));
+    image_vy = Math.max(0, Math.min(28 - tm.height, image_vy));
+
+    return [[image_hx, image_hy], [image_vx, image_vy]];
+}
+
+// "#rrggbb" -> 12-bit RGB
+function bf_parse_color(s) {
+    var c = parseInt(s.substring(1), 16);
+    return ((c >> 12) & 0xF00) | ((c >> 8) & 0xF0) | ((c >> 4) & 0x0F);
+}
+
+function bf_pad_string(s, len) {
+	var side = false;
+	while (s.length < len) {
+		if (side) s = s + " "; else s = " " + s;
+		side = !side;
+	}
+	return s;
+}
+
+function bf_pad_zeros(s, len) {
+	s = "" + s;
+	while (s.length < len) s = "0" + s;
+	return s;
+}
+
+// Throws an Error with a message for the user if the splash does not fit.
+// tm is the splash image's tilemap (see bfimg_to_tilemap), or null.
+function bf_generate_bootsplash(tm, settings) {
+    var template = settings.developer ? bin_bootfriend_dev_template : bin_bootfriend_template;
+	var splashData = new Uint8Array(1920);
+	splashData.set(template);
+    var idx = template.length;
+
+    var endTimeSeconds = settings.duration;
+    var nameLocs = settings.nameLocations;
+    var imageLocs = settings.imageLocations;
+    var bgColor = settings.backgroundColor;
+
+    splashData[0x04] = settings.color;
+    splashData[0x08] = Math.max(0x80, Math.min(0xF0, Math.round(endTimeSeconds * 75.47)));
+    splashData[0x1C] = (nameLocs[0][1] - 4) & 0xFF;
+    splashData[0x1D] = (nameLocs[0][0] - 4) & 0xFF;
+    splashData[0x1E] = (nameLocs[1][0] - 4) & 0xFF;
+    splashData[0x1F] = (224 - nameLocs[1][1] - 4) & 0xFF;
+
+    if (tm == null) tm = bfimg_empty_tilemap();
+    splashData[0x0A] = (tm.bpp == 2 ? 0x80 : 0x00) | tm.paletteCount;
+    if (tm.tileCount > 192) {
+        throw new Error("Too many unique tiles in image.");
+    }
+    if (tm.width <= 0 || tm.width > 32 || tm.height <= 0 || tm.height > 32) {
+        throw new Error("Invalid image width/height.");
+    }
+    splashData[0x0B] = tm.tileCount;
+    splashData[0x16] = tm.width;
+    splashData[0x17] = tm.height;
+
+    splashData[0x0C] = idx & 0xFF;
+    splashData[0x0D] = idx >> 8;
+    if(idx + tm.palette.length <= splashData.length) {
+        splashData.set(tm.palette, idx);
+        splashData[idx] = bgColor & 0xFF;
+        splashData[idx + 1] = bgColor >> 8;
+    }
+    idx += tm.palette.length;
+
+    splashData[0x0E] = idx & 0xFF;
+    splashData[0x0F] = idx >> 8;
+    if(idx + tm.tiles.length <= splashData.length) splashData.set(tm.tiles, idx);
+    idx += tm.tiles.length;
+
+    splashData[0x10] = idx & 0xFF;
+    splashData[0x11] = idx >> 8;
+    if(idx + tm.map.length <= splashData.length) splashData.set(tm.map, idx);
+    idx += tm.map.length;
+
+    var screenDestH = 2 * (imageLocs[0][0] + (imageLocs[0][1] * 32)) + 0x800;
+    var screenDestV = 2 * ((27 - imageLocs[1][1]) + (imageLocs[1][0] * 32)) + 0x800;
+    splashData[0x12] = screenDestH & 0xFF;
+    splashData[0x13] = screenDestH >> 8;
+    splashData[0x14] = screenDestV & 0xFF;
+    splashData[0x15] = screenDestV >> 8;
+
+    if (idx > 1920) {
+        throw new Error("Splash data too large (" + idx + " > 1920).");
+    }
+
+    if (idx <= 0x380) {
+        splashData[0x06] = 0;
+    }
+
+	return splashData;
+}
+
+function bf_generate_title(eepromType, verHi, verLo, date) {
+    var verStr = String.fromCharCode(verHi, verLo);
+
+	var dateString = bf_pad_zeros(date.getFullYear() % 100, 2)
+		+ bf_pad_zeros(date.getMonth() + 1, 2)
+		+ bf_pad_zeros(date.getDate(), 2)
+		+ bf_pad_zeros(date.getHours(), 2)
+		+ bf_pad_zeros(date.getMinutes(), 2);
+	if (eepromType == 0) return "bootfriend-inst" + verStr + " " + dateString;
+    else return "ieepsplash-inst" + verStr + " " + dateString;
+}
+
+function bf_typedArray_indexOf(haystack, needle) {
+	var haystackStr = new TextDecoder("ascii").decode(haystack);
+	return haystackStr.indexOf(needle);
+}
+
+function bf_generate_splashdata(tm, settings) {
+    if (settings.eepromType == 0) {
+        return bf_generate_bootsplash(tm, settings);
+    } else {
+        if (settings.customEeprom == null) {
+            throw new Error("No custom EEPROM provided!");
+        }
+        return settings.customEeprom;
+    }
+}
+
+function bf_generate_rom(bin, bin_size, tm, settings) {
+    if (bin_size < 0) bin_size = bin.length;
+
+	var rom_index = bf_typedArray_indexOf(bin, "bFtMp");
+	var title_index = bf_typedArray_indexOf(bin, "bootfriend-inst devel. bui");
+
+    var splashdata = bf_generate_splashdata(tm, settings);
+
+	var rom = new Uint8Array(bin_size);
+	rom.set(bin);
+    rom.set(splashdata, rom_index);
+	rom.set(Uint8Array.from(bf_pad_string(bf_generate_title(settings.eepromType, rom[title_index + 26], rom[title_index + 27], settings.date), 28), c => c.charCodeAt(0)), title_index);
+
+	return rom;
+}
+
+function bf_wwcode(data, decode) {
+	var output = new Uint8Array(data.length);
+	var prevB = 0xFF;
+	for (var i = 0; i < data.length; i++) {
+		if ((i & 0x7F) == 0) {
+			prevB = 0xFF;
+		}
+		if (decode) {
+			output[i] = data[i] ^ prevB;
+			prevB = data[i];
+		} else {
+			var b = data[i] ^ prevB;
+			prevB = b;
+			output[i] = b;
+		}
+	}
+	return output;
+}
+
+// Output types, with the file names the page downloads them as.
+const bf_image_types = {
+    "rom": "bootfriend-inst.wsc",
+    "wwfx": "bootfriend-inst.fx",
+    "wwsoft": "bootfriend-inst-wwsystem.bin",
+    "raw": "bootfriend.bin"
+};
+
+function bf_generate_image(type, tm, settings) {
+	if (type == "rom") {
+		// only the developer installer can store a .bfb file to SRAM for
+		// BootFriend to boot; elsewhere, SRAM is WonderWitch's file system
+		return bf_generate_rom(settings.developer ? bin_bootfriend_inst_dev_rom : bin_bootfriend_inst_rom, 131072, tm, settings);
+	} else if (type == "wwfx") {
+		return bf_generate_rom(bin_bootfriend_inst_fx, -1, tm, settings);
+	} else if (type == "wwsoft") {
+		return bf_wwcode(bf_generate_rom(bin_bootfriend_inst_rom, 131072, tm, settings).subarray(0, 64168), false);
+	} else if (type == "raw") {
+		return bf_generate_splashdata(tm, settings);
+	}
+}
+
+function bf_decode_base64(s) {
+	return Uint8Array.from(atob(s), c => c.charCodeAt(0))
+}
@@ -0,0 +1,373 @@
+// BootFriend for WS - Web configuration utility, tileset/tilemap conversion
+// Copyright (c) 2023 Adrian "asie" Siekierka
+//
+// Shared by the page and the encoder worker (bfimg_worker.js); does not
+// touch the DOM.
+
+function bf_reverse_bits(x) {
+    x = ((x >> 1) & 0x55) | ((x & 0x55) << 1);
+    x = ((x >> 2) & 0x33) | ((x & 0x33) << 2);
+    return ((x >>> 4) | (x << 4)) & 0xFF;
+}
+
+// Tileset/tilemap conversion
+
+const boot_tile_offset = 46;
+var bfimg_inverse_color_correct = false;
+
+function bfimg_color_to_ws(r, g, b) {
+    if (bfimg_inverse_color_correct) {
+        var r2 = (r *  124  - g *  20 - b *   4) / 100;
+        var g2 = (r *   12  + g * 140 - b *  52) / 100;
+        var b2 = (r * (-36) - g *  20 + b * 156) / 100;
+        r = Math.max(0, Math.min(255, Math.floor(r2)));
+        g = Math.max(0, Math.min(255, Math.floor(g2)));
+        b = Math.max(0, Math.min(255, Math.floor(b2)));
+    }
+    return ((r & 0xF0) << 4) | (g & 0xF0) | (b >> 4);
+}
+
+function bfimg_wscolor_to_css(col) {
+    var h = col.toString(16);
+    while (h.length < 3) h = "0" + h;
+    return "#" + h;
+}
+
+function bfimg_hflip_tile(t, bpp) {
+    var u = [];
+    for (var i = 0; i < t.length; i++) {
+        u.push(bf_reverse_bits(t[i]));
+    }
+    return u;
+}
+
+function bfimg_vflip_tile(t, bpp) {
+    var ih = t.length / bpp;
+    var u = [];
+    for (var i = 0; i < ih; i++) {
+        for (var j = 0; j < bpp; j++) {
+            u.push(t[(ih - 1 - i) * bpp + j]);
+        }
+    }
+    return u;
+}
+
+async function bfimg_decode_file(file) {
+    // use the file's own color values, as tools/bfbatch does
+    var bitmap = await createImageBitmap(file, { colorSpaceConversion: "none" });
+    var ofc = new OffscreenCanvas(bitmap.width, bitmap.height);
+    var ofc_ctx = ofc.getContext("2d");
+    ofc_ctx.drawImage(bitmap, 0, 0);
+    bitmap.close();
+    return ofc_ctx.getImageData(0, 0, ofc.width, ofc.height);
+}
+
+const bfimg_little_endian = new Uint8Array(new Uint32Array([1]).buffer)[0] == 1;
+const bfimg_reverse_bits_table = new Uint8Array(256);
+for (var i = 0; i < 256; i++) bfimg_reverse_bits_table[i] = bf_reverse_bits(i);
+
+// Throws an Error with a message for the user if the image cannot be
+// converted. progress, if given, is called with the fraction done after
+// every row of tiles.
+function bfimg_to_tilemap(imageData, backgroundColor, progress) {
+    backgroundColor = backgroundColor || 4095;
+    
+    if (imageData.width % 8 != 0 || imageData.height % 8 != 0) {
+        throw new Error("Image width/height is not a multiple of 8!");
+    }
+    if (imageData.width > 2048 || imageData.height > 2048) {
+        throw new Error("Image width/height too large!");
+    }
+
+    var data = imageData.data;
+    var width = imageData.width;
+    var pixels = new Uint16Array(imageData.width * imageData.height);
+    // read RGBA pixels as one little-endian word, unless color correcting
+    var data32 = (bfimg_inverse_color_correct || !bfimg_little_endian) ? null
+        : new Uint32Array(data.buffer, data.byteOffset, pixels.length);
+    var tilesInImage = (imageData.width >> 3) * (imageData.height >> 3);
+    var tileRows = imageData.height >> 3;
+
+    // generate palettes, calculate BPP, validate tile color count
+    // this is not optimal... but it's good enough for now?
+    // palettes are kept as arrays of colors in ascending order; pixels are
+    // converted to WS colors on the way
+    var tooLargeTiles = [];
+    var palettes = [];
+    var palettePerTile = new Uint8Array(tilesInImage);
+    var colors = new Uint16Array(4);
+    for (var iy = 0, ti = 0; iy < imageData.height; iy += 8) {
+        for (var ix = 0; ix < imageData.width; ix += 8, ti++) {
+            var colorsLength = 0;
+            var lastCol = -1;
+            for (var ty = 0; ty < 8 && colorsLength <= 4; ty++) {
+                var i = (iy+ty)*width+ix;
+                for (var tx = 0; tx < 8; tx++, i++) {
+                    var col;
+                    if (data32 != null) {
+                        var v = data32[i];
+                        col = ((v & 0xF0) << 4) | ((v >> 8) & 0xF0) | ((v >> 20) & 0x0F);
+                    } else {
+                        var di = i << 2;
+                        col = bfimg_color_to_ws(data[di], data[di+1], data[di+2]);
+                    }
+                    pixels[i] = col;
+                    if (col == lastCol) continue;
+                    lastCol = col;
+                    var k = 0;
+                    while (k < colorsLength && colors[k] != col) k++;
+                    if (k == colorsLength) {
+                        if (colorsLength == 4) { colorsLength++; break; }
+                        colors[colorsLength++] = col;
+                    }
+                }
+            }
+            if (colorsLength > 4) {
+                tooLargeTiles.push(ix + ", " + iy);
+                continue;
+            }
+
+            var paletteFound = -1;
+            for (var i = 0; i < palettes.length; i++) {
+                var palette = palettes[i];
+                var foundKeysCount = 0;
+                for (var k = 0; k < palette.length; k++) {
+                    for (var j = 0; j < colorsLength; j++) {
+                        if (colors[j] == palette[k]) { foundKeysCount++; break; }
+                    }
+                }
+                if (foundKeysCount < colorsLength) {
+                    var missingKeyCount = colorsLength - foundKeysCount;
+                    if (missingKeyCount + palette.length <= (i < 7 ? 4 : 3)) {
+                        for (var k = 0; k < colorsLength; k++) {
+                            if (palette.indexOf(colors[k]) < 0) palette.push(colors[k]);
+                        }
+                        palette.sort((a, b) => a - b);
+                        foundKeysCount = colorsLength;
+                    }
+                }
+                if (foundKeysCount == colorsLength) {
+                    paletteFound = i;
+                    break;
+                }
+            }
+            if (paletteFound < 0) {
+                // TODO: Take a smaller palette from before and swap it in, if possible.
+                paletteFound = palettes.length;
+                palettes.push(Array.from(colors.subarray(0, colorsLength)).sort((a, b) => a - b));
+            }
+            palettePerTile[ti] = paletteFound;
+        }
+        if (progress) progress(((iy >> 3) + 1) / (2 * tileRows));
+    }
+    if (tooLargeTiles.length > 0) {
+        throw new Error("Image has tiles with more than 4 colors in them: " + tooLargeTiles.join("; "));
+    }
+    if (palettes.length > 11) {
+        throw new Error("Image has more than 11 palettes, which is not currently supported.");
+    }
+    var paletteIndexSwap = [
+        /**/1,  2,  3,
+        8,  9,  10, 11,
+        4,  5,  6,  7
+    ];
+    var paletteIndexSwapInv = {};
+    for (var i = 0; i < paletteIndexSwap.length; i++) {
+        paletteIndexSwapInv[paletteIndexSwap[i]] = i;
+    }
+
+    var maxColorsPerTile = 1;
+    for (var i = 0; i < palettes.length; i++) {
+        maxColorsPerTile = Math.max(palettes[i].length, maxColorsPerTile);
+    }
+    var bpp = maxColorsPerTile > 2 ? 2 : 1;
+
+    // convert palette to data
+    var paletteData = [];
+
+    paletteData.push(backgroundColor & 0xFF); paletteData.push(backgroundColor >> 8);
+    for (var ix = 1; ix < (1 << bpp); ix++) { paletteData.push(0); paletteData.push(0); }
+
+    var maxSwappedPaletteIndex = 0;
+    for (var i = 0; i < palettes.length; i++) {
+        maxSwappedPaletteIndex = Math.max(maxSwappedPaletteIndex, paletteIndexSwap[i]);
+    }
+    for (var i = 1; i <= maxSwappedPaletteIndex; i++) {
+        var idxToRead = paletteIndexSwapInv[i];
+        var p = palettes[idxToRead] || [0,0,0,0];
+        for (var ix = 0; ix < (1 << bpp); ix++) {
+            if (p.length <= ix) { paletteData.push(0); paletteData.push(0); }
+            else { paletteData.push(p[ix] & 0xFF); paletteData.push(p[ix] >> 8); }
+        }
+    }
+
+    // color -> index within each palette
+    var colorIndices = new Uint8Array(palettes.length << 12);
+    for (var i = 0; i < palettes.length; i++) {
+        for (var k = 0; k < palettes[i].length; k++) {
+            colorIndices[(i << 12) | palettes[i][k]] = k;
+        }
+    }
+
+    // palettes in hand, let's build the tile data and tilemap
+    // tiles are compared as 32-bit words, found through an open-addressed
+    // hash table of tile numbers + 1; tile number 0 is the predefined
+    // empty tile
+    var tileSize = 8 * bpp;
+    var tileWords = tileSize >> 2;
+    var tileStore = new Uint8Array((tilesInImage + 1) * tileSize);
+    var tileStoreWords = new Uint32Array(tileStore.buffer);
+    var tileCount = 1;
+    var hashSize = 64;
+    while (hashSize < tileCount * 2 + tilesInImage * 2) hashSize <<= 1;
+    var hashTable = new Int32Array(hashSize);
+    var tileMap = new Uint8Array(tilesInImage * 2);
+
+    // candidate tiles: unflipped, H, V and HV-flipped, 16 bytes apart
+    var candidates = new Uint8Array(64);
+    var candidateWords = new Uint32Array(candidates.buffer);
+    var vflipOffsets = new Uint8Array(tileSize);
+    for (var k = 0; k < tileSize; k++) vflipOffsets[k] = (7 - (k / bpp | 0)) * bpp + (k % bpp);
+
+    function hash_candidate(v) {
+        var h = 0x811C9DC5;
+        for (var k = 0; k < tileWords; k++) h = Math.imul(h ^ candidateWords[(v << 2) + k], 0x01000193);
+        return (h ^ (h >>> 15)) & (hashSize - 1);
+    }
+
+    // returns a tile number, or -(slot + 1) to insert the tile at
+    function find_candidate(v) {
+        var slot = hash_candidate(v);
+        while (hashTable[slot] != 0) {
+            var t = hashTable[slot] - 1;
+            var k = 0;
+            while (k < tileWords && tileStoreWords[t * tileWords + k] == candidateWords[(v << 2) + k]) k++;
+            if (k == tileWords) return t;
+            slot = (slot + 1) & (hashSize - 1);
+        }
+        return -(slot + 1);
+    }
+
+    // predefined tiles
+    hashTable[-find_candidate(0) - 1] = 1;
+
+    for (var iy = 0, ti = 0; iy < imageData.height; iy += 8) {
+        for (var ix = 0; ix < imageData.width; ix += 8, ti++) {
+            var palidx = palettePerTile[ti];
+            var colorBase = palidx << 12;
+
+            for (var ty = 0; ty < 8; ty++) {
+                var b0 = 0;
+                var b1 = 0;
+                var i = (iy+ty)*width+ix;
+                for (var tx = 0; tx < 8; tx++, i++) {
+                    var idx = colorIndices[colorBase | pixels[i]];
+                    b0 = (b0 << 1) | (idx & 1);
+                    b1 = (b1 << 1) | (idx >> 1);
+                }
+                candidates[ty * bpp] = b0;
+                if (bpp >= 2) candidates[ty * bpp + 1] = b1;
+            }
+
+            var tileMapEntry = ((paletteIndexSwap[palidx]) << 9);
+            var tileMapIndex = find_candidate(0);
+            var insertAt = tileMapIndex;
+            if (tileMapIndex < 0) {
+                for (var k = 0; k < tileSize; k++) {
+                    var b = candidates[k];
+                    var vk = vflipOffsets[k];
+                    candidates[16 + k] = bfimg_reverse_bits_table[b];
+                    candidates[32 + vk] = b;
+                    candidates[48 + vk] = bfimg_reverse_bits_table[b];
+                }
+            }
+            for (var v = 1; v < 4 && tileMapIndex < 0; v++) {
+                tileMapIndex = find_candidate(v);
+                if (tileMapIndex >= 0) tileMapEntry |= v << 14;
+            }
+            if (tileMapIndex < 0) {
+                tileStore.set(candidates.subarray(0, tileSize), tileCount * tileSize);
+                hashTable[-insertAt - 1] = tileCount + 1;
+                tileMapIndex = tileCount++;
+            }
+            if (tileMapIndex > 0) tileMapIndex += boot_tile_offset - 1;
+
+            tileMapEntry |= tileMapIndex;
+            tileMap[ti * 2] = tileMapEntry & 0xFF;
+            tileMap[ti * 2 + 1] = tileMapEntry >> 8;
+        }
+        if (progress) progress(0.5 + ((iy >> 3) + 1) / (2 * tileRows));
+    }
+
+    return {
+        "bpp": bpp,
+        "tiles": tileStore.slice(tileSize, tileCount * tileSize),
+        "map": tileMap,
+        "palette": new Uint8Array(paletteData),
+        "tileCount": tileCount - 1,
+        "paletteCount": maxSwappedPaletteIndex + 1,
+        "width": imageData.width >> 3,
+        "height": imageData.height >> 3
+    };
+}
+
+function bfimg_empty_tilemap() {
+    return {
+        "bpp": 1,
+        "tiles": new Uint8Array([0, 0, 0, 0, 0, 0, 0, 0]),
+        "map": new Uint8Array([0, 0]),
+        "palette": new Uint8Array([0xFF, 0x0F, 0xFF, 0x0F]),
+        "tileCount": 1,
+        "paletteCount": 1,
+        "width": 1,
+        "height": 1
+    };
+}
+
+function bfimg_tilemap_size(tm) {
+    return tm.data.length + tm.map.length + tm.palette.length;
+}
+
+function bfimg_tilemap_to_imagedata(tm) {
+    var imageData = new ImageData(tm.width * 8, tm.height * 8);
+    var data = imageData.data;
+    var bpp = tm.bpp;
+
+    var tmi = 0;
+    for (var iy = 0; iy < imageData.height; iy += 8) {
+        for (var ix = 0; ix < imageData.width; ix += 8, tmi += 2) {
+            var tm_entry = tm.map[tmi] | (tm.map[tmi + 1] << 8);
+            var tm_tileidx = (tm_entry & 0x1FF);
+            if (tm_tileidx == 0) continue;
+            tm_tileidx -= boot_tile_offset;
+
+            var tm_tileofs = tm_tileidx*(4 << bpp);
+            var tm_pal = (tm_entry >> 9) & 0x0F;
+            var tm_palofs = tm_pal*(2 << bpp);
+            var tm_hflip = (tm_entry >> 14) & 0x01;
+            var tm_vflip = (tm_entry >> 15) & 0x01;
+            var tm_tile = [];
+            for (var i = 0; i < 8*bpp; i++) {
+                tm_tile.push(tm.tiles[tm_tileofs + i]);
+            }
+            if(tm_hflip) tm_tile = bfimg_hflip_tile(tm_tile);
+            if(tm_vflip) tm_tile = bfimg_vflip_tile(tm_tile, bpp);
+
+            for (var ty = 0; ty < 8; ty++) {
+                var b0 = tm_tile[ty*bpp];
+                var b1 = bpp >= 2 ? tm_tile[ty*bpp+1] : 0;
+                for (var tx = 0; tx < 8; tx++, b0 <<= 1, b1 <<= 1) {
+                    var bi = ((b0 & 128) >> 7) | ((b1 & 128) >> 6);
+                    var ws_col = tm.palette[tm_palofs+bi*2] | (tm.palette[tm_palofs+bi*2+1] << 8);
+                    var di = ((iy+ty)*imageData.width+ix+tx)*4;
+                    data[di] = ((ws_col >> 8) & 0x0F) * 17;
+                    data[di+1] = ((ws_col >> 4) & 0x0F) * 17;
+                    data[di+2] = (ws_col & 0x0F) * 17;
+                    data[di+3] = 255;
+                }
+            }
+        }
+    }
+
+    return imageData;
+}
@@ -0,0 +1,32 @@
+// BootFriend for WS - Web configuration utility, splash encoder worker
+// Copyright (c) 2023 Adrian "asie" Siekierka
+//
+// Decodes and converts an image file off the main thread. Receives
+// { id, file, inverseColorCorrect }; posts { id, progress } while working,
+// then { id, tilemap, preview, time } or { id, error }.
+
+importScripts("bfimg.js");
+
+onmessage = async function(e) {
+    var job = e.data;
+    try {
+        var imageData = await bfimg_decode_file(job.file);
+        bfimg_inverse_color_correct = job.inverseColorCorrect;
+
+        var lastPercent = -1;
+        var start = performance.now();
+        var tm = bfimg_to_tilemap(imageData, undefined, function(fraction) {
+            var percent = Math.floor(fraction * 100);
+            if (percent != lastPercent) {
+                lastPercent = percent;
+                postMessage({ "id": job.id, "progress": fraction });
+            }
+        });
+        var time = performance.now() - start;
+        var preview = bfimg_tilemap_to_imagedata(tm);
+        postMessage({ "id": job.id, "tilemap": tm, "preview": preview, "time": time },
+            [tm.tiles.buffer, tm.map.buffer, tm.palette.buffer, preview.data.buffer]);
+    } catch (err) {
+        postMessage({ "id": job.id, "error": err.message });
+    }
+};